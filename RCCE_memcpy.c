@@ -23,15 +23,22 @@
 //    limitations under the License.
 // 
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "RCCE_memcpy.h"
 
 //--------------------------------------------------------------------------------------
-// FUNCTION: memcpy_get
+// FUNCTION: memcpy_get_p54c
 //--------------------------------------------------------------------------------------
-// optimized memcpy for copying data from MPB to private memory
+// optimized memcpy for copying data from MPB to private memory (P54C, 32-bit only)
 //--------------------------------------------------------------------------------------
-inline static void *memcpy_get(void *dest, const void *src, size_t count)
+#if defined(__i386__)
+inline static void *memcpy_get_p54c(void *dest, const void *src, size_t count)
 {
         int h, i, j, k, l, m;     
 
@@ -69,11 +76,11 @@ inline static void *memcpy_get(void *dest, const void *src, size_t count)
 }
 
 //--------------------------------------------------------------------------------------
-// FUNCTION: memcpy_put
+// FUNCTION: memcpy_put_p54c
 //--------------------------------------------------------------------------------------
-// optimized memcpy for copying data from private memory to MPB
+// optimized memcpy for copying data from private memory to MPB (P54C, 32-bit only)
 //--------------------------------------------------------------------------------------
-inline static void *memcpy_put(void *dest, const void *src, size_t count)
+inline static void *memcpy_put_p54c(void *dest, const void *src, size_t count)
 {
         int i, j, k;
 
@@ -87,3 +94,207 @@ inline static void *memcpy_put(void *dest, const void *src, size_t count)
 
         return dest;
 }
+#endif
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: memcpy_get_sse2, memcpy_put_sse2
+//--------------------------------------------------------------------------------------
+// 16-byte kernels for x86-64 hosts (SCC_EMU and host-side tools). The P54C trick
+// of touching the destination line first is not needed here, these caches
+// allocate on write by themselves. put writes the MPB with non-temporal stores,
+// which bypass the cache just like the write-combine buffer on the chip.
+//--------------------------------------------------------------------------------------
+#if defined(__x86_64__)
+#define MEMCPY_LINE     64
+#define MEMCPY_SMALL    128
+
+inline static void *memcpy_get_sse2(void *dest, const void *src, size_t count)
+{
+        char *d = dest;
+        const char *s = src;
+
+        if (count < MEMCPY_SMALL) return memcpy(dest, src, count);
+
+        for (; count >= MEMCPY_LINE; count -= MEMCPY_LINE, s += MEMCPY_LINE, d += MEMCPY_LINE) {
+                __m128i a = _mm_loadu_si128((const __m128i*) s);
+                __m128i b = _mm_loadu_si128((const __m128i*) (s + 16));
+                __m128i c = _mm_loadu_si128((const __m128i*) (s + 32));
+                __m128i e = _mm_loadu_si128((const __m128i*) (s + 48));
+                _mm_storeu_si128((__m128i*) d, a);
+                _mm_storeu_si128((__m128i*) (d + 16), b);
+                _mm_storeu_si128((__m128i*) (d + 32), c);
+                _mm_storeu_si128((__m128i*) (d + 48), e);
+        }
+        memcpy(d, s, count);
+
+        return dest;
+}
+
+inline static void *memcpy_put_sse2(void *dest, const void *src, size_t count)
+{
+        char *d = dest;
+        const char *s = src;
+        size_t head;
+
+        if (count < MEMCPY_SMALL) return memcpy(dest, src, count);
+
+        // Non-temporal stores need an aligned destination
+        head = -(uintptr_t) d & 15;
+        memcpy(d, s, head);
+        d += head, s += head, count -= head;
+
+        for (; count >= MEMCPY_LINE; count -= MEMCPY_LINE, s += MEMCPY_LINE, d += MEMCPY_LINE) {
+                __m128i a = _mm_loadu_si128((const __m128i*) s);
+                __m128i b = _mm_loadu_si128((const __m128i*) (s + 16));
+                __m128i c = _mm_loadu_si128((const __m128i*) (s + 32));
+                __m128i e = _mm_loadu_si128((const __m128i*) (s + 48));
+                _mm_stream_si128((__m128i*) d, a);
+                _mm_stream_si128((__m128i*) (d + 16), b);
+                _mm_stream_si128((__m128i*) (d + 32), c);
+                _mm_stream_si128((__m128i*) (d + 48), e);
+        }
+        _mm_sfence();
+        memcpy(d, s, count);
+
+        return dest;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: memcpy_get_avx2, memcpy_put_avx2
+//--------------------------------------------------------------------------------------
+// the same kernels with 32-byte registers, only called if the CPU has AVX2
+//--------------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+inline static void *memcpy_get_avx2(void *dest, const void *src, size_t count)
+{
+        char *d = dest;
+        const char *s = src;
+
+        if (count < MEMCPY_SMALL) return memcpy(dest, src, count);
+
+        for (; count >= MEMCPY_LINE; count -= MEMCPY_LINE, s += MEMCPY_LINE, d += MEMCPY_LINE) {
+                __m256i a = _mm256_loadu_si256((const __m256i*) s);
+                __m256i b = _mm256_loadu_si256((const __m256i*) (s + 32));
+                _mm256_storeu_si256((__m256i*) d, a);
+                _mm256_storeu_si256((__m256i*) (d + 32), b);
+        }
+        memcpy(d, s, count);
+
+        return dest;
+}
+
+__attribute__((target("avx2")))
+inline static void *memcpy_put_avx2(void *dest, const void *src, size_t count)
+{
+        char *d = dest;
+        const char *s = src;
+        size_t head;
+
+        if (count < MEMCPY_SMALL) return memcpy(dest, src, count);
+
+        head = -(uintptr_t) d & 31;
+        memcpy(d, s, head);
+        d += head, s += head, count -= head;
+
+        for (; count >= MEMCPY_LINE; count -= MEMCPY_LINE, s += MEMCPY_LINE, d += MEMCPY_LINE) {
+                __m256i a = _mm256_loadu_si256((const __m256i*) s);
+                __m256i b = _mm256_loadu_si256((const __m256i*) (s + 32));
+                _mm256_stream_si256((__m256i*) d, a);
+                _mm256_stream_si256((__m256i*) (d + 32), b);
+        }
+        _mm_sfence();
+        memcpy(d, s, count);
+
+        return dest;
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Variant table and dispatch
+//--------------------------------------------------------------------------------------
+// memcpy_get/memcpy_put use the P54C kernels on the chip. Elsewhere they use the
+// C library memcpy, which is already vectorised on x86-64 hosts and beats the
+// SIMD kernels for cached buffers; the environment variable RCCE_MEMCPY (sse2
+// or avx2) selects one of those instead. Run memcpy_bench to compare them.
+//--------------------------------------------------------------------------------------
+typedef void *(*memcpy_func_t)(void *dest, const void *src, size_t count);
+
+typedef struct {
+        const char *name;
+        memcpy_func_t get;
+        memcpy_func_t put;
+} memcpy_variant_t;
+
+static const memcpy_variant_t memcpy_variants[] = {
+        { "memcpy", memcpy, memcpy },
+#if defined(__i386__)
+        { "p54c", memcpy_get_p54c, memcpy_put_p54c },
+#elif defined(__x86_64__)
+        { "sse2", memcpy_get_sse2, memcpy_put_sse2 },
+        { "avx2", memcpy_get_avx2, memcpy_put_avx2 },
+#endif
+};
+
+#define MEMCPY_VARIANTS (sizeof(memcpy_variants) / sizeof(memcpy_variants[0]))
+
+// Returns false for kernels the CPU cannot run
+static int memcpy_supported(const memcpy_variant_t *variant)
+{
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (!strcmp(variant->name, "avx2")) return __builtin_cpu_supports("avx2");
+#endif
+        return 1;
+}
+
+#if !defined(__i386__)
+static const memcpy_variant_t *memcpy_current;
+
+static const memcpy_variant_t *memcpy_select(void)
+{
+        const char *name = getenv("RCCE_MEMCPY");
+        size_t i;
+
+        for (i = 0; name && i < MEMCPY_VARIANTS; i++) {
+                if (!strcmp(name, memcpy_variants[i].name) && memcpy_supported(&memcpy_variants[i])) {
+                        return memcpy_current = &memcpy_variants[i];
+                }
+        }
+
+        return memcpy_current = memcpy_variants;
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: memcpy_get
+//--------------------------------------------------------------------------------------
+// optimized memcpy for copying data from MPB to private memory
+//--------------------------------------------------------------------------------------
+void *memcpy_get(void *dest, const void *src, size_t count)
+{
+#if defined(__i386__)
+        return memcpy_get_p54c(dest, src, count);
+#else
+        const memcpy_variant_t *variant = memcpy_current;
+
+        if (variant == NULL) variant = memcpy_select();
+        return variant->get(dest, src, count);
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: memcpy_put
+//--------------------------------------------------------------------------------------
+// optimized memcpy for copying data from private memory to MPB
+//--------------------------------------------------------------------------------------
+void *memcpy_put(void *dest, const void *src, size_t count)
+{
+#if defined(__i386__)
+        return memcpy_put_p54c(dest, src, count);
+#else
+        const memcpy_variant_t *variant = memcpy_current;
+
+        if (variant == NULL) variant = memcpy_select();
+        return variant->put(dest, src, count);
+#endif
+}
@@ -0,0 +1,15 @@
+//***************************************************************************************
+// Optimized memcpy routines from and to MPB, see RCCE_memcpy.c
+//***************************************************************************************
+#ifndef RCCE_MEMCPY_H
+#define RCCE_MEMCPY_H
+
+#include <stddef.h>
+
+// copy from MPB to private memory
+void *memcpy_get(void *dest, const void *src, size_t count);
+
+// copy from private memory to MPB
+void *memcpy_put(void *dest, const void *src, size_t count);
+
+#endif
@@ -0,0 +1,445 @@
+/*
+ * Micro-benchmarks for the MPB and LUT transports.
+ *
+ * Every active node runs this program (under SCC_EMU, one process per
+ * emulated core is forked). -n sets the number of active nodes of the
+ * topology, so node counts can be swept without a rebuild. Node 0 drives
+ * the tests and writes one CSV line per test and message size:
+ *
+ *   test,size,nodes,iterations,min_us,mean_us,p50_us,p90_us,p99_us,max_us,mbps
+ *
+ * Latencies are per message (half the round trip for pingpong, one call for
+ * barrier and allreduce); mbps is the payload throughput of the whole test.
+ * isend is bandwidth with the sender going through the send queue
+ * (includes/sccsend.h).
+ * bcast sends LUT buffers from node 0 to all other nodes at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "scc_comm_func.h"
+#include "includes/distribution.h"
+#include "includes/memfun.h"
+#include "includes/scc.h"
+#include "includes/sccmalloc.h"
+#include "includes/sccsend.h"
+#ifdef SCC_EMU
+#include "sccemu.h"
+#endif
+
+#define MIN_MSG     8
+#define MAX_MSG     (8 * 1024)
+#define MIN_LUT     (1024 * 1024)
+#define MAX_LUT     (256 * 1024 * 1024)
+#define ISEND_DEPTH 16
+
+static int nodes;
+static int iterations = 1000;
+static FILE *out;
+static char *buf;
+static double *samples;
+
+static double now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Messages above the frame limit are streamed as several frames. */
+static void send_msg(int node, void *src, int size)
+{
+  int cpy;
+
+  do {
+    cpy = min(size, MPB_MAX_PAYLOAD);
+    cpy_mem_to_mpb(node, src, cpy);
+    src = (char*) src + cpy;
+    size -= cpy;
+  } while (size > 0);
+}
+
+/* As send_msg through the send queue, with up to ISEND_DEPTH frames in
+ * flight. */
+static void isend_msg(int node, void *src, int size)
+{
+  static mpb_send_t reqs[ISEND_DEPTH];
+  static int next;
+  struct iovec iov;
+  int cpy;
+
+  do {
+    cpy = min(size, MPB_MAX_PAYLOAD);
+    iov.iov_base = src;
+    iov.iov_len = cpy;
+    if (next >= ISEND_DEPTH) mpb_send_wait(&reqs[next % ISEND_DEPTH]);
+    mpb_isendv(&reqs[next++ % ISEND_DEPTH], node, MPB_MSG_DATA, &iov, 1, NULL, NULL);
+    src = (char*) src + cpy;
+    size -= cpy;
+  } while (size > 0);
+}
+
+static void recv_msg(int node, void *dst, int size)
+{
+  int cpy;
+
+  do {
+    cpy = min(size, MPB_MAX_PAYLOAD);
+    mpb_select_from(node_location, node);
+    cpy_mpb_to_mem(node_location, dst, cpy);
+    dst = (char*) dst + cpy;
+    size -= cpy;
+  } while (size > 0);
+}
+
+/* Node 0 only sends once it has finished the previous test and the others
+ * only answer then, so no token can show up in the middle of a test. */
+static void barrier(void)
+{
+  int node;
+  char token = 0;
+
+  if (node_location == 0) {
+    for (node = 1; node < nodes; node++) send_msg(node, &token, 1);
+    for (node = 1; node < nodes; node++) recv_msg(node, &token, 1);
+  } else {
+    recv_msg(0, &token, 1);
+    send_msg(0, &token, 1);
+  }
+}
+
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double*) a, y = *(const double*) b;
+  return x < y ? -1 : x > y;
+}
+
+static void report(const char *test, size_t size, int count, double total_us, double bytes)
+{
+  int i;
+  double sum = 0;
+
+  qsort(samples, count, sizeof(double), compare);
+  for (i = 0; i < count; i++) sum += samples[i];
+
+  fprintf(out, "%s,%lu,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", test, (unsigned long) size, nodes, count,
+          samples[0], sum / count, samples[count / 2], samples[count * 9 / 10], samples[count * 99 / 100],
+          samples[count - 1], bytes / total_us);
+  fflush(out);
+}
+
+/* Node 0 and node 1 bounce a message back and forth. */
+static void pingpong(int size)
+{
+  int i;
+  double start, begin;
+
+  if (node_location > 1) return;
+
+  begin = now_us();
+  for (i = 0; i < iterations; i++) {
+    if (node_location == 0) {
+      start = now_us();
+      send_msg(1, buf, size);
+      recv_msg(1, buf, size);
+      samples[i] = (now_us() - start) / 2;
+    } else {
+      recv_msg(0, buf, size);
+      send_msg(0, buf, size);
+    }
+  }
+
+  if (node_location == 0) report("pingpong", size, iterations, now_us() - begin, 2.0 * size * iterations);
+}
+
+/* Node 1 streams to node 0, which acknowledges the last message; with
+ * async through the send queue. */
+static void bandwidth(int size, bool async)
+{
+  int i;
+  double start, begin;
+
+  if (node_location > 1) return;
+
+  begin = now_us();
+  for (i = 0; i < iterations; i++) {
+    if (node_location == 1) {
+      if (async) isend_msg(0, buf, size);
+      else send_msg(0, buf, size);
+    } else {
+      start = now_us();
+      recv_msg(1, buf, size);
+      samples[i] = now_us() - start;
+    }
+  }
+
+  if (node_location == 1) {
+    if (async) mpb_send_flush();
+    recv_msg(0, buf, 1);
+  } else {
+    send_msg(1, buf, 1);
+    report(async ? "isend" : "bandwidth", size, iterations, now_us() - begin, (double) size * iterations);
+  }
+}
+
+/* All other nodes stream to node 0 at the same time. */
+static void fanin(int size)
+{
+  int i, count = iterations * (nodes - 1);
+  double start, begin;
+
+  begin = now_us();
+  if (node_location == 0) {
+    for (i = 0; i < count; i++) {
+      start = now_us();
+      recv_msg(1 + i % (nodes - 1), buf, size);
+      samples[i] = now_us() - start;
+    }
+    report("fanin", size, count, now_us() - begin, (double) size * count);
+  } else {
+    for (i = 0; i < iterations; i++) send_msg(0, buf, size);
+  }
+}
+
+/* Node 0 streams to all other nodes round-robin; they acknowledge the end. */
+static void fanout(int size)
+{
+  int i, node, count = iterations * (nodes - 1);
+  double start, begin;
+
+  begin = now_us();
+  if (node_location == 0) {
+    for (i = 0; i < count; i++) {
+      start = now_us();
+      send_msg(1 + i % (nodes - 1), buf, size);
+      samples[i] = now_us() - start;
+    }
+    for (node = 1; node < nodes; node++) recv_msg(node, buf, 1);
+    report("fanout", size, count, now_us() - begin, (double) size * count);
+  } else {
+    for (i = 0; i < iterations; i++) recv_msg(0, buf, size);
+    send_msg(0, buf, 1);
+  }
+}
+
+/* Node 1 publishes a buffer through SNetDistribPack, node 0 maps it with
+ * SNetDistribUnpack, touches every page and acknowledges with the sum of
+ * the bytes it read. The calibrated limits are lifted so that every size is
+ * remapped rather than copied through the MPB. */
+static void lutremap(size_t size, int count)
+{
+  int i;
+  size_t off, inlineMax = distribInlineMax, streamMax = distribStreamMax;
+  char ack = 0, *data;
+  lut_addr_t addr;
+  double start, begin;
+
+  if (node_location > 1) return;
+
+  distribInlineMax = distribStreamMax = 0;
+  data = node_location == 1 ? SCCMallocPtr(size) : NULL;
+
+  begin = now_us();
+  for (i = 0; i < count; i++) {
+    if (node_location == 1) {
+      addr.node = 0;
+      SNetDistribPack(data, &addr, size, true);
+      recv_msg(0, &ack, 1);
+    } else {
+      start = now_us();
+      SNetDistribUnpack(&data, &addr, true);
+      for (off = 0; off < size; off += PAGE_SIZE) ack += data[off];
+      SCCFree(data);
+      send_msg(1, &ack, 1);
+      samples[i] = now_us() - start;
+    }
+  }
+
+  distribInlineMax = inlineMax;
+  distribStreamMax = streamMax;
+  if (node_location == 1) SCCFree(data);
+  else report("lutremap", size, count, now_us() - begin, (double) size * count);
+}
+
+/* Node 0 broadcasts a buffer to the readers, which check a byte of every page
+ * before they release it; the next round rewrites the buffer, so an early
+ * completion shows up as bad data. With three or more nodes the last one
+ * stays out and queues a frame at every reader before each round, so the
+ * broadcast has to be picked out from behind other traffic. */
+static void bcast(size_t size, int count)
+{
+  int i, node, slot, k, readers[CORES], bystander = nodes > 2 ? nodes - 1 : 0;
+  size_t off;
+  char token = 0, *data = NULL;
+  snet_bcast_t bc;
+  double start, begin;
+
+  k = bystander ? nodes - 2 : nodes - 1;
+  if (node_location == 0) {
+    data = SCCMallocPtr(size);
+    for (node = 0; node < k; node++) readers[node] = node + 1;
+  }
+
+  begin = now_us();
+  for (i = 0; i < count; i++) {
+    if (node_location == 0) {
+      for (off = 0; off < size; off += PAGE_SIZE) data[off] = (char) (i + off / PAGE_SIZE);
+      if (bystander) recv_msg(bystander, &token, 1);
+
+      start = now_us();
+      SNetDistribBcast(data, size, readers, k, &bc);
+      slot = bc.slot;
+      SNetDistribBcastWait(&bc);
+      samples[i] = now_us() - start;
+
+      flush();
+      if (BCAST_COUNT(node_location, slot) != 0) {
+        fprintf(stderr, "bcast: %d releases missing or extra\n", BCAST_COUNT(node_location, slot));
+        exit(1);
+      }
+    } else if (node_location == bystander) {
+      for (node = 1; node <= k; node++) send_msg(node, &token, 1);
+      send_msg(0, &token, 1);
+    } else {
+      data = SNetDistribRecvBcast(&bc);
+      for (off = 0; off < size; off += PAGE_SIZE) {
+        if (data[off] != (char) (i + off / PAGE_SIZE)) {
+          fprintf(stderr, "bcast: node %d read bad data at %lu in round %d\n", node_location, (unsigned long) off, i);
+          exit(1);
+        }
+      }
+      SNetDistribReleaseBcast(&bc);
+      if (bystander) recv_msg(bystander, &token, 1);
+    }
+  }
+
+  if (node_location == 0) {
+    SCCFree(data);
+    report("bcast", size, count, now_us() - begin, (double) size * count * k);
+  }
+}
+
+/* All nodes run scc_barrier back to back; node 0 reports the latency. */
+static void coll_barrier(void)
+{
+  int i;
+  double start, begin = now_us();
+
+  for (i = 0; i < iterations; i++) {
+    start = now_us();
+    scc_barrier();
+    samples[i] = now_us() - start;
+  }
+
+  if (node_location == 0) report("barrier", 0, iterations, now_us() - begin, 0);
+}
+
+/* All nodes sum size bytes of doubles with scc_allreduce. */
+static void coll_allreduce(int size)
+{
+  int i;
+  double start, begin = now_us(), in[COLL_MAX_PAYLOAD / sizeof(double)], out[COLL_MAX_PAYLOAD / sizeof(double)];
+
+  memset(in, 0, sizeof(in));
+  for (i = 0; i < iterations; i++) {
+    start = now_us();
+    scc_allreduce(in, out, size, scc_sum_double);
+    samples[i] = now_us() - start;
+  }
+
+  if (node_location == 0) report("allreduce", size, iterations, now_us() - begin, (double) size * iterations);
+}
+
+int main(int argc, char **argv)
+{
+  int opt, size, lut_iterations = 20;
+  size_t lut;
+  char *tests = "pingpong,bandwidth,isend,fanin,fanout,barrier,allreduce,lutremap,bcast", value[16];
+
+  out = stdout;
+  while ((opt = getopt(argc, argv, "n:i:l:o:t:")) != -1) {
+    switch (opt) {
+      case 'n': nodes = atoi(optarg); break;
+      case 'i': iterations = atoi(optarg); break;
+      case 'l': lut_iterations = atoi(optarg); break;
+      case 't': tests = optarg; break;
+      case 'o':
+        if ((out = fopen(optarg, "w")) == NULL) {
+          perror("fopen");
+          exit(1);
+        }
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n nodes] [-i iterations] [-l lut iterations] [-o csv file] "
+                "[-t pingpong,bandwidth,isend,fanin,fanout,barrier,allreduce,lutremap,bcast]\n", argv[0]);
+        exit(1);
+    }
+  }
+
+  /* -n overrides the number of active nodes of the topology. */
+  if (nodes) {
+    snprintf(value, sizeof(value), "%d", nodes);
+    setenv("SCC_ACTIVE_NODES", value, 1);
+  }
+  scc_topology_init();
+  nodes = topology.active_nodes;
+
+  if (nodes < 2) {
+    fprintf(stderr, "Need at least 2 active nodes\n");
+    exit(1);
+  }
+
+#ifdef SCC_EMU
+  EmuFork(nodes);
+#endif
+
+  scc_init();
+  if (node_location >= nodes) return 0;
+
+  buf = SNetMemAlloc(MAX_MSG);
+  samples = SNetMemAlloc(sizeof(double) * iterations * (nodes - 1) + sizeof(double) * lut_iterations);
+  memset(buf, 0, MAX_MSG);
+
+  if (node_location == 0) {
+    fprintf(out, "test,size,nodes,iterations,min_us,mean_us,p50_us,p90_us,p99_us,max_us,mbps\n");
+  }
+
+  barrier();
+  for (size = MIN_MSG; size <= MAX_MSG; size *= 2) {
+    if (strstr(tests, "pingpong")) pingpong(size), barrier();
+    if (strstr(tests, "bandwidth")) bandwidth(size, false), barrier();
+    if (strstr(tests, "isend")) bandwidth(size, true), barrier();
+    if (strstr(tests, "fanin")) fanin(size), barrier();
+    if (strstr(tests, "fanout")) fanout(size), barrier();
+  }
+
+  if (strstr(tests, "barrier")) coll_barrier(), barrier();
+  if (strstr(tests, "allreduce")) {
+    for (size = sizeof(double); size <= COLL_MAX_PAYLOAD; size *= 2) coll_allreduce(size), barrier();
+  }
+
+  if (strstr(tests, "lutremap") && remap) {
+    for (lut = MIN_LUT; lut <= MAX_LUT; lut *= 4) lutremap(lut, lut_iterations), barrier();
+  }
+  if (strstr(tests, "bcast") && remap) {
+    for (lut = MIN_LUT; lut <= MAX_LUT; lut *= 4) bcast(lut, lut_iterations), barrier();
+  }
+
+  SCCStop();
+
+#ifdef SCC_EMU
+  if (node_location == 0) {
+    while (wait(NULL) > 0);
+    EmuDestroy();
+  }
+#endif
+
+  return 0;
+}
@@ -27,12 +27,74 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "config.h"
+#ifdef SCC_EMU
+#include "sccemu.h"
+#endif
 
 // Variables
 int NCMDeviceFD; // File descriptor for non-cachable memory (e.g. config regs).
 int MPBDeviceFD; // File descriptor for message passing buffers.
 
+// Page-granular cache of mapped config register pages. Every page is mapped once by
+// the first access and reused by all later ReadConfigReg/SetConfigReg/MallocConfigReg
+// calls until FreeConfigReg(NULL) tears the cache down. Lookups are lock-free, new
+// entries are published under ConfigCacheLock...
+#define CONFIG_CACHE_SIZE 256
+typedef struct {
+  volatile unsigned int page; // Physical page address + 1 (0: unused slot)
+  t_vcharp addr;              // Virtual address of the mapped page
+} tConfigPage;
+static tConfigPage ConfigCache[CONFIG_CACHE_SIZE];
+static pthread_mutex_t ConfigCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+// MapConfigPage returns the virtual address of a page of config registers, mapping it
+// on the first access. If the cache is full, the page is mapped without being cached
+// and *cached is cleared so that the caller unmaps it again...
+// 
+// Parameter: alignedAddr               - Page aligned physical address
+//            cached                    - Set if the returned mapping is owned by the cache
+// 
+static t_vcharp MapConfigPage(unsigned int alignedAddr, int *cached) {
+  unsigned int slot = (alignedAddr / getpagesize()) % CONFIG_CACHE_SIZE, probes;
+  t_vcharp MappedAddr;
+
+  *cached = 1;
+  for (probes = 0; probes < CONFIG_CACHE_SIZE && ConfigCache[slot].page; probes++) {
+    if (ConfigCache[slot].page == alignedAddr + 1) return ConfigCache[slot].addr;
+    slot = (slot + 1) % CONFIG_CACHE_SIZE;
+  }
+
+  pthread_mutex_lock(&ConfigCacheLock);
+  // Another thread may have mapped the page in the meantime...
+  slot = (alignedAddr / getpagesize()) % CONFIG_CACHE_SIZE;
+  for (probes = 0; probes < CONFIG_CACHE_SIZE && ConfigCache[slot].page; probes++) {
+    if (ConfigCache[slot].page == alignedAddr + 1) {
+      pthread_mutex_unlock(&ConfigCacheLock);
+      return ConfigCache[slot].addr;
+    }
+    slot = (slot + 1) % CONFIG_CACHE_SIZE;
+  }
+
+  MappedAddr = (t_vcharp) mmap(NULL, getpagesize(), PROT_WRITE|PROT_READ, MAP_SHARED, NCMDeviceFD, alignedAddr);
+  if (MappedAddr == MAP_FAILED) {
+          perror("mmap");
+          exit(-1);
+  }
+
+  if (probes < CONFIG_CACHE_SIZE) {
+    ConfigCache[slot].addr = MappedAddr;
+    __sync_synchronize();
+    ConfigCache[slot].page = alignedAddr + 1;
+  } else {
+    *cached = 0;
+  }
+  pthread_mutex_unlock(&ConfigCacheLock);
+
+  return MappedAddr;
+}
+
 // InitAPI opens the RCKMEM device drivers. This routine needs to be invoked
 // once before using any other API functions! The successmessage can be disabled.
 // 
@@ -40,6 +102,12 @@ int MPBDeviceFD; // File descriptor for message passing buffers.
 // Return value: %
 // 
 void InitAPI(int printMessages) {
+#ifdef SCC_EMU
+  // Back CRBs, MPBs and DRAM with shared memory instead of the devices...
+  EmuInit(printMessages);
+  return;
+#endif
+
   // Open driver device "/dev/rckncm" for memory mapped register access
   // or access to other non cachable memory locations...
   if ((NCMDeviceFD=open("/dev/rckncm", O_RDWR|O_SYNC))<0) {
@@ -85,18 +153,19 @@ void SetConfigBit(unsigned int ConfigAddr, int BitPos, int BitValue) {
 //            RegValue                  - Value to write to specified register...
 // 
 void SetConfigReg(unsigned int ConfigAddr, int RegValue) {
+#ifdef SCC_EMU
+  *(volatile int*)EmuConfigReg(ConfigAddr) = RegValue;
+#else
   t_vcharp MappedAddr;
   unsigned int alignedAddr = ConfigAddr & (~(getpagesize()-1));
   unsigned int pageOffset = ConfigAddr - alignedAddr;
+  int cached;
 
-  MappedAddr = (t_vcharp) mmap(NULL, getpagesize(), PROT_WRITE|PROT_READ, MAP_SHARED, NCMDeviceFD, alignedAddr);
-  if (MappedAddr == MAP_FAILED) {
-          perror("mmap");
-          exit(-1);
-  }
+  MappedAddr = MapConfigPage(alignedAddr, &cached);
 
   *(int*)(MappedAddr+pageOffset) = RegValue;
-  munmap((void*)MappedAddr, getpagesize());
+  if (!cached) munmap((void*)MappedAddr, getpagesize());
+#endif
   return;
 }
 
@@ -109,20 +178,20 @@ void SetConfigReg(unsigned int ConfigAddr, int RegValue) {
 // Return value: Content of the specified config register
 // 
 int ReadConfigReg(unsigned int ConfigAddr) {
-  int result;
+#ifdef SCC_EMU
+  return *(volatile int*)EmuConfigReg(ConfigAddr);
+#else
+  int result, cached;
   t_vcharp MappedAddr;
   unsigned int alignedAddr = ConfigAddr & (~(getpagesize()-1));
   unsigned int pageOffset = ConfigAddr - alignedAddr;
 
-  MappedAddr = (t_vcharp) mmap(NULL, getpagesize(), PROT_WRITE|PROT_READ, MAP_SHARED, NCMDeviceFD, alignedAddr);
-  if (MappedAddr == MAP_FAILED) {
-          perror("mmap");
-          exit(-1);
-  }
+  MappedAddr = MapConfigPage(alignedAddr, &cached);
 
   result = *(int*)(MappedAddr+pageOffset);
-  munmap((void*)MappedAddr, getpagesize());
+  if (!cached) munmap((void*)MappedAddr, getpagesize());
   return result;
+#endif
 }
 
 // MallocConfigReg performs a memory map operation on ConfigAddr (physical address) and
@@ -134,28 +203,48 @@ int ReadConfigReg(unsigned int ConfigAddr) {
 // Return value: ConfigRegVirtualAddr   - Virtual address of configuration register.
 // 
 int* MallocConfigReg(unsigned int ConfigAddr) {
+#ifdef SCC_EMU
+  return EmuConfigReg(ConfigAddr);
+#else
   t_vcharp MappedAddr;
   unsigned int alignedAddr = ConfigAddr & (~(getpagesize()-1));
   unsigned int pageOffset = ConfigAddr - alignedAddr;
+  int cached;
 
-  MappedAddr = (t_vcharp) mmap(NULL, getpagesize(), PROT_WRITE|PROT_READ, MAP_SHARED, NCMDeviceFD, alignedAddr);
-  if (MappedAddr == MAP_FAILED) {
-          perror("mmap");
-          exit(-1);
-  }
+  MappedAddr = MapConfigPage(alignedAddr, &cached);
 
   return (int*)(MappedAddr+pageOffset);
+#endif
 }
 
-// FreeConfigReg unmaps a memory location that has been mapped with the MallocConfigReg()
-// function...
+// FreeConfigReg releases a memory location that has been mapped with the MallocConfigReg()
+// function. Pages owned by the mapping cache stay mapped; FreeConfigReg(NULL) tears down
+// the whole cache and must only be called once no mapped register is used any more...
 // 
-// Parameter: ConfigRegVirtualAddr      - Virtual address of configuration register.
+// Parameter: ConfigRegVirtualAddr      - Virtual address of configuration register (or NULL).
 // 
 void FreeConfigReg(int* ConfigRegVirtualAddr) {
-  t_vcharp MappedAddr;
-  unsigned int alignedAddr = (int)ConfigRegVirtualAddr & (~(getpagesize()-1));
-  munmap((void*)alignedAddr, getpagesize());
+#ifdef SCC_EMU
+  // Emulated registers stay mapped for the lifetime of the process...
+  return;
+#endif
+  unsigned long alignedAddr = (unsigned long)ConfigRegVirtualAddr & (~(getpagesize()-1));
+  int slot;
+
+  pthread_mutex_lock(&ConfigCacheLock);
+  for (slot = 0; slot < CONFIG_CACHE_SIZE; slot++) {
+    if (!ConfigCache[slot].page) continue;
+    if (ConfigRegVirtualAddr == NULL) {
+      munmap((void*)ConfigCache[slot].addr, getpagesize());
+      ConfigCache[slot].page = 0;
+    } else if ((unsigned long)ConfigCache[slot].addr == alignedAddr) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&ConfigCacheLock);
+
+  // Only mappings made while the cache was full are unmapped right away...
+  if (ConfigRegVirtualAddr != NULL && slot == CONFIG_CACHE_SIZE) munmap((void*)alignedAddr, getpagesize());
   return;
 }
 
@@ -174,6 +263,12 @@ void MPBalloc(t_vcharp *MPB, int x, int y, int core, unsigned char isOwnMPB) {
     *MPB = NULL;
     return;
   }
+
+#ifdef SCC_EMU
+  // The own MPB is just another core's MPB in the emulation...
+  *MPB = EmuMPB(x, y, core);
+  return;
+#endif
   
   MappedAddr = (t_vcharp) mmap(NULL, MPBSIZE, PROT_WRITE|PROT_READ, MAP_SHARED, MPBDeviceFD, alignedAddr);
   if (MappedAddr == MAP_FAILED)
@@ -190,7 +285,9 @@ void MPBalloc(t_vcharp *MPB, int x, int y, int core, unsigned char isOwnMPB) {
 // Parameter: MPB             - Pointer to MPB area (virtual address)
 // 
 void MPBunalloc(t_vcharp *MPB) {
+#ifndef SCC_EMU
   munmap((void*)*MPB, MPBSIZE);
+#endif
   *MPB = NULL;
 }
 
@@ -313,10 +313,11 @@ extern int ReadConfigReg(unsigned int ConfigAddr);
 // 
 extern int* MallocConfigReg(unsigned int ConfigAddr);
 
-// FreeConfigReg unmaps a memory location that has been mapped with the MallocConfigReg()
-// function...
+// FreeConfigReg releases a memory location that has been mapped with the MallocConfigReg()
+// function. Pages owned by the mapping cache stay mapped; FreeConfigReg(NULL) tears down
+// the whole cache and must only be called once no mapped register is used any more...
 // 
-// Parameter: ConfigRegVirtualAddr      - Virtual address of configuration register.
+// Parameter: ConfigRegVirtualAddr      - Virtual address of configuration register (or NULL).
 // 
 extern void FreeConfigReg(int* ConfigRegVirtualAddr);
 
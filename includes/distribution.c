@@ -1,6 +1,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 
 //#include "SCC_API.h"
@@ -10,12 +11,237 @@
 #include "../config.h"
 #include <stdint.h>
 #include "bool.h"
+#include "../RCCE_memcpy.h"
 #include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
 
 extern  node_location;
 
 extern bool remap;
 
+/* Without remapping, Pack copies the data page by page through the
+ * COPY_SLOTS entries of the remote window. The calling thread maps the next
+ * page while helper threads (SCC_COPY_THREADS, default COPY_THREADS) still
+ * copy the previous ones; with 0 helpers it copies each page itself. */
+#define COPY_THREADS  1
+
+typedef struct {
+  int slot;
+  size_t offset, size;
+  const char *src;
+} copy_job_t;
+
+static pthread_once_t copyOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t copyLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobDone = PTHREAD_COND_INITIALIZER;
+
+/* Jobs are queued in slot order, so the queue never holds more than
+ * COPY_SLOTS of them; pending also counts the ones being copied. */
+static copy_job_t jobs[COPY_SLOTS];
+static int jobHead, jobTail, pending;
+static bool slotBusy[COPY_SLOTS];
+static int copyThreads;
+
+static void *CopyThread(void *arg)
+{
+  copy_job_t job;
+
+  while (true) {
+    pthread_mutex_lock(&jobLock);
+    while (jobHead == jobTail) pthread_cond_wait(&jobReady, &jobLock);
+    job = jobs[jobHead++ % COPY_SLOTS];
+    pthread_mutex_unlock(&jobLock);
+
+    memcpy((char*) remote + job.slot * PAGE_SIZE + job.offset, job.src, job.size);
+
+    pthread_mutex_lock(&jobLock);
+    slotBusy[job.slot] = false;
+    pending--;
+    pthread_cond_broadcast(&jobDone);
+    pthread_mutex_unlock(&jobLock);
+  }
+
+  return NULL;
+}
+
+static void StartCopyThreads(void)
+{
+  char *env = getenv("SCC_COPY_THREADS");
+  pthread_t thread;
+  int i;
+
+  copyThreads = env ? atoi(env) : COPY_THREADS;
+  for (i = 0; i < copyThreads; i++) {
+    if (pthread_create(&thread, NULL, CopyThread, NULL)) {
+      printf("Could not start copy thread\n");
+      exit(1);
+    }
+    pthread_detach(thread);
+  }
+}
+
+static void CopyToRemote(lut_addr_t *addr, const char *src, size_t size)
+{
+  int slot = 0;
+  size_t cpySize;
+
+  pthread_once(&copyOnce, StartCopyThreads);
+  pthread_mutex_lock(&copyLock);
+
+  while (size > 0) {
+    cpySize = size < PAGE_SIZE - addr->offset ? size : PAGE_SIZE - addr->offset;
+
+    pthread_mutex_lock(&jobLock);
+    while (slotBusy[slot]) pthread_cond_wait(&jobDone, &jobLock);
+    pthread_mutex_unlock(&jobLock);
+
+    LUT(node_location, REMOTE_LUT + slot) = LUT(addr->node, addr->lut++);
+    SCCSyncLut(REMOTE_LUT + slot, 1);
+
+    if (copyThreads) {
+      pthread_mutex_lock(&jobLock);
+      slotBusy[slot] = true;
+      jobs[jobTail++ % COPY_SLOTS] = (copy_job_t) { slot, addr->offset, cpySize, src };
+      pending++;
+      pthread_cond_signal(&jobReady);
+      pthread_mutex_unlock(&jobLock);
+    } else {
+      memcpy((char*) remote + slot * PAGE_SIZE + addr->offset, src, cpySize);
+    }
+
+    size -= cpySize;
+    src += cpySize;
+    slot = (slot + 1) % COPY_SLOTS;
+
+    if (addr->offset) addr->offset = 0;
+  }
+
+  pthread_mutex_lock(&jobLock);
+  while (pending) pthread_cond_wait(&jobDone, &jobLock);
+  pthread_mutex_unlock(&jobLock);
+
+  pthread_mutex_unlock(&copyLock);
+}
+
+/* Return the payload of the next frame on the selected channel, in place
+ * unless the frame wraps around the end of the ring. */
+static const void *PeekMessage(void *buf, int size)
+{
+  struct iovec iov[2];
+
+  while (mpb_peekv(node_location, iov) < 0) mpb_wait(node_location);
+
+  if (iov[0].iov_len >= size) return iov[0].iov_base;
+
+  memcpy(buf, iov[0].iov_base, iov[0].iov_len);
+  memcpy((char*) buf + iov[0].iov_len, iov[1].iov_base, size - iov[0].iov_len);
+  return buf;
+}
+
+/* With remapping, data fields up to distribInlineMax bytes travel inline in
+ * one MPB frame, up to distribStreamMax as a stream of frames and larger ones
+ * through a LUT remap. SNetDistribCalibrate picks the limits; until then
+ * every data field is remapped. */
+size_t distribInlineMax = 0, distribStreamMax = 0;
+
+#define CALIBRATE_ROUNDS  8
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Measure what a byte through the MPB and a LUT mapping cost on this node,
+ * using the own channel of the own MPB (no other core writes there), and
+ * put the crossover between the two where they cost the same. The
+ * environment variables SCC_INLINE_MAX and SCC_STREAM_MAX override it. */
+void SNetDistribCalibrate(void)
+{
+  int i, size = MPB_MAX_PAYLOAD;
+  unsigned char lut;
+  char buf[MPBSIZE], *env;
+  double start, elapsed, copy = 0, map = 0;
+  void *ring = (void*) B_CHANNEL(node_location, CHANNEL(node_location));
+  size_t crossover = 0;
+
+  if (remap && CHANNEL(node_location) != SHARED_CHANNEL) {
+    memset(buf, 0, size);
+    for (i = 0; i < CALIBRATE_ROUNDS; i++) {
+      start = now_ns();
+      memcpy_put(ring, buf, size);
+      flush();
+      memcpy_get(buf, ring, size);
+      elapsed = (now_ns() - start) / size;
+      if (i == 0 || elapsed < copy) copy = elapsed;
+
+      start = now_ns();
+      if ((lut = SCCMallocLut(1)) == 0) break;
+      LUT(node_location, lut) = LUT(node_location, LOCAL_LUT);
+      SCCSyncLut(lut, 1);
+      SCCFree(SCCAddr2Ptr((lut_addr_t) { node_location, lut, 0 }));
+      elapsed = now_ns() - start;
+      if (i == 0 || elapsed < map) map = elapsed;
+    }
+
+    if (i == CALIBRATE_ROUNDS && copy > 0) crossover = map / copy;
+  }
+
+  distribInlineMax = crossover < size ? crossover : size;
+  distribStreamMax = crossover;
+
+  if ((env = getenv("SCC_INLINE_MAX"))) distribInlineMax = atol(env);
+  if ((env = getenv("SCC_STREAM_MAX"))) distribStreamMax = atol(env);
+  if (distribInlineMax > size) distribInlineMax = size;
+
+  if (DEBUG) {
+    printf("SNetDistribCalibrate: %.2f ns/byte MPB, %.0f ns per mapping, inline up to %lu, stream up to %lu\n",
+           copy, map, (unsigned long) distribInlineMax, (unsigned long) distribStreamMax);
+  }
+}
+
+/* Messages above the frame limit go as several frames, sent under
+ * mpb_lock_dest so that they follow each other in the sender's channel; on
+ * the shared channel it also keeps the other senders out until the last. */
+static void SendChunks(int node, int type, const char *src, size_t size)
+{
+  struct iovec iov;
+
+  mpb_lock_dest(node);
+  do {
+    iov.iov_base = (void*) src;
+    iov.iov_len = size < MPB_MAX_PAYLOAD ? size : MPB_MAX_PAYLOAD;
+    mpb_sendv(node, type, &iov, 1);
+    src += iov.iov_len;
+    size -= iov.iov_len;
+  } while (size > 0);
+  mpb_unlock_dest(node);
+}
+
+/* Counterpart of SendChunks; the first frame is on the selected channel. */
+static void RecvChunks(char *dst, size_t size)
+{
+  const mpb_frame_t *frame;
+  int sender, len;
+
+  while ((frame = mpb_peek_frame(node_location)) == NULL) mpb_wait(node_location);
+  sender = frame->sender;
+
+  while (true) {
+    len = size < MPB_MAX_PAYLOAD ? size : MPB_MAX_PAYLOAD;
+    cpy_mpb_to_mem(node_location, dst, len);
+    dst += len;
+    size -= len;
+    if (size == 0) break;
+
+    mpb_select_from(node_location, sender);
+  }
+}
 
 void SNetDistribPack(void *src, ...)
 {
@@ -23,7 +249,7 @@ void SNetDistribPack(void *src, ...)
   va_list args;
   lut_addr_t *addr;
   unsigned char node;
-  size_t size, cpySize;
+  size_t size;
 
   va_start(args, src);
   addr = va_arg(args, void*);
@@ -31,38 +257,47 @@ void SNetDistribPack(void *src, ...)
   isData = va_arg(args, bool);
   va_end(args);
 
-printf("addr->node:%s\n",addr->node);
-printf("addr->lut:%s\n",addr->lut);
+if (DEBUG) {
+printf("addr->node:%d\n",addr->node);
+printf("addr->lut:%d\n",addr->lut);
 printf("addr->offset:%u\n",addr->offset);
 printf("size:%i\n",size);
 printf("remap:%d\n",remap);
 printf("isData:%d\n",isData);
+}
 
   flush();
   if (isData) {
-    if (remap) {
-      node = addr->node;
-      *addr = SCCPtr2Addr(src);
-      
-      cpy_mem_to_mpb(node, addr, sizeof(lut_addr_t));
-      cpy_mem_to_mpb(node, &size, sizeof(size_t));
-    } else {
-      while (size > 0) {
-        LUT(node_location, REMOTE_LUT) = LUT(addr->node, addr->lut++);
-
-        cpySize = min(size, PAGE_SIZE - addr->offset);
-        memcpy(((char*) remote + addr->offset), src, cpySize);
+    if (remap && size <= distribInlineMax) {
+      scc_stats_pack(STATS_PACK_INLINE, size);
+      SendChunks(addr->node, MPB_MSG_INLINE, src, size);
+    } else if (remap && size <= distribStreamMax) {
+      struct iovec msg = { &size, sizeof(size_t) };
 
-        size -= cpySize;
-        src += cpySize;
+      scc_stats_pack(STATS_PACK_STREAM, size);
+      mpb_lock_dest(addr->node);
+      mpb_sendv(addr->node, MPB_MSG_STREAM, &msg, 1);
+      SendChunks(addr->node, MPB_MSG_DATA, src, size);
+      mpb_unlock_dest(addr->node);
+    } else if (remap) {
+      struct iovec msg[2];
 
-        if (addr->offset) addr->offset = 0;
-      }
+      scc_stats_pack(STATS_PACK_REMAP, size);
+      node = addr->node;
+      *addr = SCCPtr2Addr(src);
 
+      msg[0].iov_base = addr;
+      msg[0].iov_len = sizeof(lut_addr_t);
+      msg[1].iov_base = &size;
+      msg[1].iov_len = sizeof(size_t);
+      mpb_sendv(node, MPB_MSG_REMAP, msg, 2);
+    } else {
+      scc_stats_pack(STATS_PACK_COPY, size);
+      CopyToRemote(addr, src, size);
       FOOL_WRITE_COMBINE;
     }
   } else {
-    cpy_mem_to_mpb(addr->node, src, size);
+    SendChunks(addr->node, MPB_MSG_DATA, src, size);
   }
 }
 
@@ -72,7 +307,6 @@ void SNetDistribUnpack(void *dst, ...)
   size_t size;
   va_list args;
   lut_addr_t *addr;
-  unsigned char i;
 
   va_start(args, dst);
   addr = va_arg(args, void*);
@@ -80,25 +314,346 @@ void SNetDistribUnpack(void *dst, ...)
   if (!isData) size = va_arg(args, size_t);
   va_end(args);
 
+  /* Every Pack is a single message from one sender, read it in one go. */
+  if (!isData || remap) mpb_select(node_location);
+
+  if (isData && remap) {
+    const mpb_frame_t *frame;
+    char *data;
+
+    while ((frame = mpb_peek_frame(node_location)) == NULL) mpb_wait(node_location);
+
+    /* Copied transports arrive in a fresh local buffer, released with
+     * SCCFree just like a remapped one. */
+    if (frame->type == MPB_MSG_INLINE) {
+      data = SCCMallocPtr(frame->len);
+      cpy_mpb_to_mem(node_location, data, frame->len);
+      *addr = SCCPtr2Addr(data);
+      *(void**) dst = data;
+      return;
+    } else if (frame->type == MPB_MSG_STREAM) {
+      int sender = frame->sender;
+
+      cpy_mpb_to_mem(node_location, &size, sizeof(size_t));
+      mpb_select_from(node_location, sender);
+      data = SCCMallocPtr(size);
+      RecvChunks(data, size);
+      *addr = SCCPtr2Addr(data);
+      *(void**) dst = data;
+      return;
+    }
+  }
+
   if (isData) {
     if (remap) {
       unsigned char node, lut, count;
-      cpy_mpb_to_mem(node_location, addr, sizeof(lut_addr_t));
-      cpy_mpb_to_mem(node_location, &size, sizeof(size_t));
+      char buf[sizeof(lut_addr_t) + sizeof(size_t)];
+      const char *msg = PeekMessage(buf, sizeof(buf));
+
+      *addr = *(const lut_addr_t*) msg;
+      size = *(const size_t*) (msg + sizeof(lut_addr_t));
+      mpb_consume(node_location);
 
       node = addr->node;
       count = (size + addr->offset + PAGE_SIZE - 1) / PAGE_SIZE;
-      lut = SCCMallocLut(count);
-
-      for (i = 0; i < count; i++) {
-        LUT(node_location, lut + i) = LUT(node, addr->lut + i);
-      }
+      lut = SCCMapLut(node, addr->lut, count);
 
       addr->lut = lut;
     }
 
     *(void**) dst = SCCAddr2Ptr(*addr);
   } else {
-    cpy_mpb_to_mem(node_location, dst, size);
+    RecvChunks(dst, size);
   }
 }
+
+/* Wire format of a record: header, one entry per field, the tags. */
+typedef struct {
+  uint16_t nfields, ntags;
+} record_hdr_t;
+
+typedef struct {
+  lut_addr_t addr;
+  uint32_t size;
+} record_field_t;
+
+#define RECORD_DESC_MAX   (sizeof(record_hdr_t) + RECORD_MAX_FIELDS * sizeof(record_field_t) + \
+                           RECORD_MAX_TAGS * sizeof(int))
+
+void SNetDistribPackRecord(int node, snet_record_t *rec)
+{
+  int i;
+  size_t total = 0;
+  lut_addr_t dst;
+  record_hdr_t hdr = { rec->nfields, rec->ntags };
+  record_field_t desc[RECORD_MAX_FIELDS];
+  char buf[RECORD_DESC_MAX], *pos = buf;
+
+  if (rec->nfields > RECORD_MAX_FIELDS || rec->ntags > RECORD_MAX_TAGS) {
+    printf("Record too big!\n");
+    exit(3);
+  }
+
+  for (i = 0; i < rec->nfields; i++) {
+    desc[i].size = rec->fields[i].size;
+    total += desc[i].size;
+
+    if (desc[i].size == 0) {
+      memset(&desc[i].addr, 0, sizeof(lut_addr_t));
+    } else if (remap) {
+      desc[i].addr = SCCPtr2Addr(rec->fields[i].data);
+    } else {
+      desc[i].addr = dst = rec->fields[i].addr;
+      CopyToRemote(&dst, rec->fields[i].data, rec->fields[i].size);
+    }
+  }
+
+  scc_stats_pack(STATS_PACK_RECORD, total);
+  if (!remap) FOOL_WRITE_COMBINE;
+  flush();
+
+  /* With many active nodes a frame holds less than the largest descriptor,
+   * so it goes as a message of several frames. */
+  memcpy(pos, &hdr, sizeof(hdr));
+  pos += sizeof(hdr);
+  memcpy(pos, desc, rec->nfields * sizeof(record_field_t));
+  pos += rec->nfields * sizeof(record_field_t);
+  memcpy(pos, rec->tags, rec->ntags * sizeof(int));
+  pos += rec->ntags * sizeof(int);
+  SendChunks(node, MPB_MSG_RECORD, buf, pos - buf);
+}
+
+void SNetDistribUnpackRecord(snet_record_t *rec)
+{
+  int i, j, n = 0;
+  unsigned char node = 0, lut[RECORD_MAX_FIELDS], count[RECORD_MAX_FIELDS], first, pages;
+  unsigned char base[RECORD_MAX_FIELDS];
+  char buf[RECORD_DESC_MAX];
+  const record_hdr_t *hdr;
+  const record_field_t *desc;
+
+  mpb_select(node_location);
+  hdr = PeekMessage(buf, sizeof(record_hdr_t));
+  RecvChunks(buf, sizeof(record_hdr_t) + hdr->nfields * sizeof(record_field_t) + hdr->ntags * sizeof(int));
+
+  hdr = (const record_hdr_t*) buf;
+  desc = (const record_field_t*) (hdr + 1);
+  rec->nfields = hdr->nfields;
+  rec->ntags = hdr->ntags;
+  memcpy(rec->tags, desc + rec->nfields, rec->ntags * sizeof(int));
+  rec->run = NULL;
+
+  for (i = 0; i < rec->nfields; i++) {
+    rec->fields[i].size = desc[i].size;
+    rec->fields[i].addr = desc[i].addr;
+  }
+
+  if (!remap) {
+    for (i = 0; i < rec->nfields; i++) {
+      rec->fields[i].data = desc[i].size ? SCCAddr2Ptr(desc[i].addr) : NULL;
+    }
+    return;
+  }
+
+  /* Collect the LUT runs of all fields; a field whose pages are already
+   * part of a run (fields packed next to each other) shares that run. */
+  for (i = 0; i < rec->nfields; i++) {
+    if (desc[i].size == 0) continue;
+
+    node = desc[i].addr.node;
+    first = desc[i].addr.lut;
+    pages = (desc[i].addr.offset + desc[i].size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    for (j = 0; j < n; j++) {
+      if (lut[j] <= first && first + pages <= lut[j] + count[j]) break;
+      if (j == n - 1 && first <= lut[j] + count[j] && first >= lut[j]) {
+        count[j] = first + pages - lut[j];
+        break;
+      }
+    }
+    if (j == n) {
+      lut[n] = first;
+      count[n++] = pages;
+    }
+  }
+
+  if (n == 0) {
+    for (i = 0; i < rec->nfields; i++) rec->fields[i].data = NULL;
+    return;
+  }
+
+  first = SCCMapLutRuns(node, lut, count, n);
+  if (first == 0) {
+    printf("Could not map record\n");
+    exit(1);
+  }
+
+  for (j = 0, pages = 0; j < n; pages += count[j++]) base[j] = first + pages;
+
+  for (i = 0; i < rec->nfields; i++) {
+    if (desc[i].size == 0) {
+      rec->fields[i].data = NULL;
+      continue;
+    }
+
+    for (j = 0; j < n; j++) {
+      if (lut[j] <= desc[i].addr.lut && desc[i].addr.lut < lut[j] + count[j]) break;
+    }
+    rec->fields[i].addr.node = node_location;
+    rec->fields[i].addr.lut = base[j] + desc[i].addr.lut - lut[j];
+    rec->fields[i].data = SCCAddr2Ptr(rec->fields[i].addr);
+  }
+
+  rec->run = SCCAddr2Ptr((lut_addr_t) { node_location, first, 0 });
+}
+
+void SNetDistribFreeRecord(snet_record_t *rec)
+{
+  if (rec->run) SCCFree(rec->run);
+  rec->run = NULL;
+}
+
+/* Wire format of a broadcast notification: the published pages, the slot of
+ * the origin's reader count and the nodes the receiver passes it on to. */
+typedef struct {
+  lut_addr_t addr;
+  size_t size;
+  uint8_t origin, slot, count;
+  uint8_t nodes[CORES];
+} bcast_msg_t;
+
+/* Slots of the own broadcasts in flight; box threads claim and free them
+ * with compare-and-swap. */
+static volatile uint16_t bcastUsed;
+
+static int MeshDistance(int a, int b)
+{
+  return abs(X_PID(a) - X_PID(b)) + abs(Y_PID(a) - Y_PID(b));
+}
+
+/* Pass msg on to its nodes along a binomial tree: sorted by mesh distance
+ * from here, the far half goes to its nearest node, which forwards it in
+ * turn, and the near half is split again. */
+static void BcastForward(bcast_msg_t *msg)
+{
+  int i, j, n = msg->count, half;
+  uint8_t nodes[CORES], tmp;
+  struct iovec iov;
+
+  memcpy(nodes, msg->nodes, n);
+  for (i = 1; i < n; i++) {
+    for (j = i; j > 0 && MeshDistance(node_location, nodes[j]) < MeshDistance(node_location, nodes[j - 1]); j--) {
+      tmp = nodes[j];
+      nodes[j] = nodes[j - 1];
+      nodes[j - 1] = tmp;
+    }
+  }
+
+  while (n > 0) {
+    half = n / 2;
+    msg->count = n - half - 1;
+    memcpy(msg->nodes, nodes + half + 1, msg->count);
+
+    iov.iov_base = msg;
+    iov.iov_len = offsetof(bcast_msg_t, nodes) + msg->count;
+    mpb_sendv(nodes[half], MPB_MSG_BCAST, &iov, 1);
+    n = half;
+  }
+}
+
+void SNetDistribBcast(void *src, size_t size, const int *nodes, int k, snet_bcast_t *bc)
+{
+  bcast_msg_t msg;
+  int i, slot;
+  uint16_t used;
+
+  if (!remap) {
+    printf("Broadcast needs remapping!\n");
+    exit(3);
+  }
+
+  do {
+    used = bcastUsed;
+    for (slot = 0; slot < BCAST_SLOTS && used & 1 << slot; slot++);
+    if (slot == BCAST_SLOTS || k > CORES) {
+      printf("Too many broadcasts in flight!\n");
+      exit(3);
+    }
+  } while (!__sync_bool_compare_and_swap(&bcastUsed, used, used | 1 << slot));
+
+  bc->data = src;
+  bc->size = size;
+  bc->origin = node_location;
+  bc->slot = slot;
+
+  scc_stats_pack(STATS_PACK_BCAST, size);
+
+  /* The count must be in place before the first reader can release. */
+  BCAST_COUNT(node_location, slot) = k;
+  FOOL_WRITE_COMBINE;
+
+  msg.addr = SCCPtr2Addr(src);
+  msg.size = size;
+  msg.origin = node_location;
+  msg.slot = slot;
+  msg.count = k;
+  for (i = 0; i < k; i++) msg.nodes[i] = nodes[i];
+
+  flush();
+  BcastForward(&msg);
+}
+
+bool SNetDistribBcastDone(snet_bcast_t *bc)
+{
+  if (bc->slot < 0) return true;
+
+  flush();
+  if (BCAST_COUNT(node_location, bc->slot)) return false;
+
+  /* The slot may be claimed again right away, so forget it. */
+  __sync_fetch_and_and(&bcastUsed, ~(1 << bc->slot));
+  bc->slot = -1;
+  return true;
+}
+
+void SNetDistribBcastWait(snet_bcast_t *bc)
+{
+  while (!SNetDistribBcastDone(bc)) usleep(1);
+}
+
+void *SNetDistribRecvBcast(snet_bcast_t *bc)
+{
+  bcast_msg_t msg;
+  unsigned char lut, count;
+
+  mpb_select_type(node_location, MPB_MSG_BCAST);
+  cpy_mpb_to_mem(node_location, &msg, sizeof(msg));
+
+  /* Hand it on before mapping, so the subtree is not held up by us. */
+  if (msg.count) BcastForward(&msg);
+
+  count = (msg.size + msg.addr.offset + PAGE_SIZE - 1) / PAGE_SIZE;
+  lut = SCCMapLut(msg.addr.node, msg.addr.lut, count);
+  if (lut == 0) {
+    printf("Could not map broadcast\n");
+    exit(1);
+  }
+
+  bc->data = SCCAddr2Ptr((lut_addr_t) { node_location, lut, msg.addr.offset });
+  bc->size = msg.size;
+  bc->origin = msg.origin;
+  bc->slot = msg.slot;
+  return bc->data;
+}
+
+void SNetDistribReleaseBcast(snet_bcast_t *bc)
+{
+  SCCFree(bc->data);
+  bc->data = NULL;
+
+  lock(bc->origin);
+  flush();
+  BCAST_COUNT(bc->origin, bc->slot)--;
+  FOOL_WRITE_COMBINE;
+  unlock(bc->origin);
+}
@@ -1,6 +1,65 @@
 #ifndef _SNET_DISTRIBUTION_H_
 #define _SNET_DISTRIBUTION_H_
 
+#include "bool.h"
+#include "sccmalloc.h"
+
+#define RECORD_MAX_FIELDS   32
+#define RECORD_MAX_TAGS     32
+
+/* One data field of a record. data is the field on the sending side and where
+ * it can be read after SNetDistribUnpackRecord. addr is only used without
+ * remapping: the destination, as for SNetDistribPack. */
+typedef struct {
+  void *data;
+  size_t size;
+  lut_addr_t addr;
+} snet_field_t;
+
+/* A whole record travels as one message describing all fields and tags.
+ * With remapping the receiver maps the pages of all fields as one LUT run,
+ * rec->run, which SNetDistribFreeRecord releases. */
+typedef struct {
+  int nfields, ntags;
+  snet_field_t fields[RECORD_MAX_FIELDS];
+  int tags[RECORD_MAX_TAGS];
+  void *run;
+} snet_record_t;
+
+/* A broadcast of one published buffer, on the origin and on every reader. */
+typedef struct {
+  void *data;
+  size_t size;
+  int origin, slot;
+} snet_bcast_t;
+
 void SNetDistribPack(void *src, ...);
 void SNetDistribUnpack(void *dst, ...);
+
+/* Transport limits for data fields with remapping, see SNetDistribCalibrate;
+ * both are 0 (always remap) until it has run. */
+extern size_t distribInlineMax, distribStreamMax;
+
+/* Measure MPB and LUT costs on this node and set the limits. Called by
+ * scc_init; SCC_INLINE_MAX and SCC_STREAM_MAX override the result. */
+void SNetDistribCalibrate(void);
+
+void SNetDistribPackRecord(int node, snet_record_t *rec);
+void SNetDistribUnpackRecord(snet_record_t *rec);
+void SNetDistribFreeRecord(snet_record_t *rec);
+
+/* Publish size bytes at src to the k given nodes with remapping. The pages
+ * are described once and the notification travels along a tree over the
+ * mesh; every reader maps the pages itself. src must stay untouched until
+ * SNetDistribBcastDone (or Wait) reports that all readers have released it.
+ * Up to BCAST_SLOTS broadcasts of a node can be in flight. */
+void SNetDistribBcast(void *src, size_t size, const int *nodes, int k, snet_bcast_t *bc);
+bool SNetDistribBcastDone(snet_bcast_t *bc);
+void SNetDistribBcastWait(snet_bcast_t *bc);
+
+/* Wait for a broadcast, from whichever channel (other frames stay queued),
+ * pass it on to the subtree and map it; returns the data. Release it with
+ * SNetDistribReleaseBcast, which also tells the origin. */
+void *SNetDistribRecvBcast(snet_bcast_t *bc);
+void SNetDistribReleaseBcast(snet_bcast_t *bc);
 #endif /* _SNET_DISTRIBUTION_H_ */
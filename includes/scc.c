@@ -2,77 +2,930 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h> /*for uint16_t*/
+#include <sys/uio.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "scc.h"
 #include "bool.h"
-#include "../RCCE_memcpy.c"
+#include "../RCCE_memcpy.h"
+#ifdef SCC_EMU
+#include "../sccemu.h"
+#endif
 
 
-void cpy_mpb_to_mem(int node, void *dst, int size)
+scc_topology_t topology = { DLPEL_ACTIVE_NODES, CORES, PAGES_PER_CORE, MAX_PAGES };
+int mpb_channels, mpb_ring_size;
+
+/* Channel of the own MPB that cpy_mpb_to_mem reads from. */
+static int rx_channel = 0;
+
+/* Sequence number of the next frame to each destination. */
+static uint32_t tx_seq[CORES];
+
+/* Box threads and the progress thread of sccsend.c all send; dest_lock[node]
+ * keeps the send state for node consistent and the frames of one message
+ * together, see mpb_lock_dest. dest_depth counts the nested holds of the
+ * owner; on the shared channel the outermost one also holds the CRB lock. */
+static pthread_mutex_t dest_lock[CORES];
+static int dest_depth[CORES];
+static pthread_once_t dest_once = PTHREAD_ONCE_INIT;
+
+/* Credit state, see CREDIT: bytes sent to and end of the own channel at each
+ * destination, and bytes consumed from each channel of the own MPB. */
+static uint32_t tx_sent[CORES];
+static int tx_end[CORES];
+static uint32_t rx_consumed[CORES];
+
+/* Batch being served on each channel, see MPB_MSG_BATCH: frame is the
+ * header of the message at pos. */
+typedef struct {
+  mpb_frame_t frame;
+  int pos, len;
+  char data[MPB_BATCH_MAX];
+} rx_batch_t;
+
+static rx_batch_t rx_batch[CORES + 1];
+
+/* Payload bytes of the head message of each channel that cpy_mpb_to_mem has
+ * already read. */
+static int rx_offset[CORES + 1];
+
+static int *topology_key(const char *key)
+{
+  if (!strcmp(key, "active_nodes")) return &topology.active_nodes;
+  if (!strcmp(key, "cores")) return &topology.cores;
+  if (!strcmp(key, "pages_per_core")) return &topology.pages_per_core;
+  if (!strcmp(key, "max_pages")) return &topology.max_pages;
+  return NULL;
+}
+
+static void topology_env(const char *name, int *value)
+{
+  char *env = getenv(name);
+  if (env) *value = atoi(env);
+}
+
+void scc_topology_init(void)
+{
+  char line[256], key[64], *name = getenv("SCC_TOPOLOGY");
+  int value, *field;
+  FILE *file;
+
+  if (name) {
+    if ((file = fopen(name, "r")) == NULL) {
+      printf("Could not open topology file %s\n", name);
+      exit(1);
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+      if (line[0] == '#' || sscanf(line, " %63[a-z_] = %d", key, &value) != 2) continue;
+      if ((field = topology_key(key)) == NULL) {
+        printf("Unknown topology key %s in %s\n", key, name);
+        exit(1);
+      }
+      *field = value;
+    }
+    fclose(file);
+  }
+
+  topology_env("SCC_ACTIVE_NODES", &topology.active_nodes);
+  topology_env("SCC_CORES", &topology.cores);
+  topology_env("SCC_PAGES_PER_CORE", &topology.pages_per_core);
+  topology_env("SCC_MAX_PAGES", &topology.max_pages);
+
+  mpb_channels = topology.active_nodes + 1;
+  mpb_ring_size = ((MPBSIZE - B_START) / MPB_CHANNELS) & ~(MPB_LINE_SIZE - 1);
+
+  if (topology.cores < 1 || topology.cores > CORES
+      || topology.active_nodes < 1 || topology.active_nodes > topology.cores
+      || topology.pages_per_core <= LINUX_PRIV_PAGES || topology.pages_per_core > PAGES_PER_CORE
+      || topology.max_pages < 2 * (topology.pages_per_core - LINUX_PRIV_PAGES) || topology.max_pages > MAX_PAGES
+      || mpb_ring_size < 4 * MPB_LINE_SIZE) {
+    printf("Invalid topology: %d of %d cores active, %d pages per core, %d pages per node\n",
+           topology.active_nodes, topology.cores, topology.pages_per_core, topology.max_pages);
+    exit(1);
+  }
+}
+
+void mpb_init(int node)
+{
+  int ch, i;
+
+  flush();
+  for (ch = 0; ch < MPB_CHANNELS; ch++) {
+    START(node, ch) = 0;
+    END(node, ch) = 0;
+    WRITING(node, ch) = false;
+    if (ch < SHARED_CHANNEL) CREDIT(node, ch) = HELLO(node, ch) = 0;
+  }
+  for (i = 0; i < COLL_LINES * MPB_LINE_SIZE; i++) *(mpbs[node] + F_OFFSET + i) = 0;
+  memset(tx_sent, 0, sizeof(tx_sent));
+  memset(tx_end, 0, sizeof(tx_end));
+  memset(rx_consumed, 0, sizeof(rx_consumed));
+  for (ch = 0; ch < MPB_CHANNELS; ch++) rx_batch[ch].pos = rx_batch[ch].len = rx_offset[ch] = 0;
+  /* Start with an initial handling run to avoid a cross-core race. */
+  HANDLING(node) = 1;
+  SLEEPING(node) = false;
+  rx_channel = 0;
+}
+
+/* Node 0 writes a fresh token to every other active node until that node has
+ * echoed it, then token + 1 to let them go. A token written before the
+ * node's mpb_init is wiped and written again; an echo always comes after
+ * node 0's own mpb_init. */
+void mpb_start(void)
+{
+  int node, acked, n = topology.active_nodes;
+  uint32_t token;
+  struct timespec ts;
+
+  if (node_location >= n) return;
+
+  if (node_location == 0) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    token = 2 + 2 * (uint32_t) (ts.tv_nsec & 0x3fffffff);
+
+    while (true) {
+      acked = 0;
+      flush();
+      for (node = 1; node < n; node++) {
+        if (HELLO(0, node) == token) acked++;
+        else HELLO(node, 0) = token;
+      }
+      FOOL_WRITE_COMBINE;
+      if (acked == n - 1) break;
+      usleep(1);
+    }
+
+    for (node = 1; node < n; node++) HELLO(node, 0) = token + 1;
+    FOOL_WRITE_COMBINE;
+  } else {
+    for (flush(); (token = HELLO(node_location, 0)) == 0; flush()) usleep(1);
+    HELLO(0, node_location) = token;
+    FOOL_WRITE_COMBINE;
+    for (flush(); HELLO(node_location, 0) != token + 1; flush()) usleep(1);
+  }
+}
+
+/* Raise the doorbell of node: pulse GLCFG_XINTR, which the kernel turns into
+ * a SIGUSR1 for the process on that core. */
+void mpb_ring(int node)
+{
+#ifdef SCC_EMU
+  EmuDoorbellRing(irq_pins[node]);
+#else
+  int glcfg = *irq_pins[node];
+
+  *irq_pins[node] = glcfg | IRQ_BIT;
+  *irq_pins[node] = glcfg & ~IRQ_BIT;
+#endif
+}
+
+/* A channel holds a message while it has frames or an unfinished batch. */
+static inline bool channel_ready(int node, int ch)
+{
+  return rx_batch[ch].pos < rx_batch[ch].len || START(node, ch) != END(node, ch);
+}
+
+static bool mpb_pending(int node)
+{
+  int ch;
+
+  flush();
+  for (ch = 0; ch < MPB_CHANNELS; ch++) {
+    if (channel_ready(node, ch)) return true;
+  }
+
+  return false;
+}
+
+/* Block until a frame is pending in the own MPB. SLEEPING tells the senders
+ * to ring; it is set before the final check so no frame can slip through
+ * between the check and the wait (the timeout covers lost signals). */
+void mpb_wait(int node)
+{
+#ifdef SCC_EMU
+  int seen;
+#else
+  sigset_t set;
+  struct timespec timeout = { 0, MPB_SLEEP_US * 1000 };
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+#endif
+
+  TRACE(TRACE_WAIT_BEGIN, 0, 0, 0);
+  scc_stats_flush();
+  while (!mpb_pending(node)) {
+#ifdef SCC_EMU
+    seen = *irq_pins[node];
+#endif
+    SLEEPING(node) = true;
+    FOOL_WRITE_COMBINE;
+
+    if (!mpb_pending(node)) {
+#ifdef SCC_EMU
+      EmuDoorbellWait(irq_pins[node], seen, MPB_SLEEP_US);
+#else
+      sigtimedwait(&set, NULL, &timeout);
+#endif
+    }
+
+    SLEEPING(node) = false;
+    FOOL_WRITE_COMBINE;
+  }
+  TRACE(TRACE_WAIT_END, 0, 0, 0);
+}
+
+/* Poll the channels round-robin, starting after the one served last, and
+ * make the first one holding a frame the source of subsequent reads. */
+int mpb_select(int node)
+{
+  int i, ch, spins;
+
+  while (true) {
+    for (spins = 0; spins < MPB_POLL_SPINS; spins++) {
+      flush();
+      for (i = 1; i <= MPB_CHANNELS; i++) {
+        ch = (rx_channel + i) % MPB_CHANNELS;
+        if (channel_ready(node, ch)) return rx_channel = ch;
+      }
+    }
+    mpb_wait(node);
+  }
+}
+
+/* Like mpb_select, but only the channel sender writes to is considered, so
+ * frames from other nodes stay queued. */
+int mpb_select_from(int node, int sender)
+{
+  int spins, ch = CHANNEL(sender);
+
+  while (true) {
+    for (spins = 0; spins < MPB_POLL_SPINS; spins++) {
+      flush();
+      if (channel_ready(node, ch)) return rx_channel = ch;
+    }
+    mpb_wait(node);
+  }
+}
+
+/* Count and trace a received frame. */
+static inline void count_rx(const mpb_frame_t *frame)
+{
+  TRACE(TRACE_RECV, frame->sender, frame->seq, frame->len);
+  scc_stats_rx(frame->sender, frame->len);
+}
+
+/* Hand bytes consumed from channel ch back to its sender. */
+static inline void return_credits(int node, int ch, int bytes)
+{
+  if (!CREDITED(ch, node)) return;
+  rx_consumed[ch] += bytes;
+  CREDIT(ch, node) = rx_consumed[ch];
+}
+
+/* Describe the payload of the frame at pos as up to two segments. Header and
+ * payload never share a line, so a wrap splits the payload between lines. */
+static int frame_payload(int node, int ch, int pos, struct iovec *iov)
+{
+  const mpb_frame_t *frame = (const mpb_frame_t*) (B_CHANNEL(node, ch) + pos);
+  int len = frame->len, off = (pos + MPB_LINE_SIZE) % B_SIZE;
+
+  iov[0].iov_base = (void*) (B_CHANNEL(node, ch) + off);
+  iov[0].iov_len = min(len, B_SIZE - off);
+  iov[1].iov_base = (void*) B_CHANNEL(node, ch);
+  iov[1].iov_len = len - iov[0].iov_len;
+  return len;
+}
+
+/* Copy size bytes from the MPB at src: whole lines straight to dst, the tail
+ * through a line buffer, so memcpy_get only reads whole lines. The padding
+ * of the frame makes the tail line readable; a src off the line start (the
+ * rest of a partly read message) is copied as it is. */
+static void get_lines(void *dst, const void *src, int size)
 {
-  int start, end, cpy;
+  char line[MPB_LINE_SIZE];
+  int whole = size & ~(MPB_LINE_SIZE - 1);
+
+  if ((uintptr_t) src & (MPB_LINE_SIZE - 1)) {
+    memcpy_get(dst, src, size);
+    return;
+  }
+
+  if (whole) memcpy_get(dst, src, whole);
+  if (size > whole) {
+    memcpy_get(line, (const char*) src + whole, MPB_LINE_SIZE);
+    memcpy((char*) dst + whole, line, size - whole);
+  }
+}
+
+/* Copy the batch frame at pos of channel ch into its rx_batch. */
+static void batch_load(int node, int ch, int pos)
+{
+  rx_batch_t *batch = &rx_batch[ch];
+  struct iovec iov[2];
+
+  batch->len = frame_payload(node, ch, pos, iov);
+  batch->pos = 0;
+  batch->frame = *(const mpb_frame_t*) (B_CHANNEL(node, ch) + pos);
+  get_lines(batch->data, iov[0].iov_base, iov[0].iov_len);
+  if (iov[1].iov_len) get_lines(batch->data + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+}
+
+/* Drop the off bytes of the payload in iov that were read already; returns
+ * what is left. */
+static int skip_read(struct iovec *iov, int len, int off)
+{
+  if (off >= iov[0].iov_len) {
+    iov[0].iov_base = (char*) iov[1].iov_base + (off - iov[0].iov_len);
+    iov[0].iov_len = len - off;
+    iov[1].iov_len = 0;
+  } else {
+    iov[0].iov_base = (char*) iov[0].iov_base + off;
+    iov[0].iov_len -= off;
+  }
+
+  return len - off;
+}
+
+/* Make the head message of channel ch a batched one if it is: load a batch
+ * frame at the head and release it right away. Returns the rx_batch serving
+ * the channel, with frame describing the message, or NULL. */
+static rx_batch_t *batch_head(int node, int ch)
+{
+  rx_batch_t *batch = &rx_batch[ch];
+  const mpb_frame_t *frame;
+  const mpb_sub_t *sub;
+  int start;
+
+  if (batch->pos >= batch->len) {
+    start = START(node, ch);
+    if (start == END(node, ch)) return NULL;
+
+    frame = (const mpb_frame_t*) (B_CHANNEL(node, ch) + start);
+    if (frame->type != MPB_MSG_BATCH) return NULL;
+
+    batch_load(node, ch, start);
+    count_rx(frame);
+    START(node, ch) = (start + FRAME_SIZE(frame->len)) % B_SIZE;
+    return_credits(node, ch, FRAME_SIZE(frame->len));
+    FOOL_WRITE_COMBINE;
+  }
+
+  sub = (const mpb_sub_t*) (batch->data + batch->pos);
+  batch->frame.len = sub->len;
+  batch->frame.type = sub->type;
+  return batch;
+}
+
+/* Zero-copy access to the head frame of the selected channel: mpb_peek
+ * returns the contiguous start of its payload, mpb_peekv the unread payload as
+ * up to two segments. Both return -1 when the channel is empty. The payload
+ * stays valid until the frame is released by mpb_consume. */
+int mpb_peek(int node, void **ptr, int *len)
+{
+  struct iovec iov[2];
+
+  if (mpb_peekv(node, iov) < 0) return -1;
+
+  *ptr = iov[0].iov_base;
+  *len = iov[0].iov_len;
+  return *len;
+}
+
+int mpb_peekv(int node, struct iovec *iov)
+{
+  int len, start, ch = rx_channel;
+  rx_batch_t *batch;
 
   flush();
-  start = START(node);
-  end = END(node);
+  if ((batch = batch_head(node, ch)) != NULL) {
+    iov[0].iov_base = batch->data + batch->pos + sizeof(mpb_sub_t);
+    iov[0].iov_len = len = batch->frame.len;
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+  } else {
+    start = START(node, ch);
+    if (start == END(node, ch)) return -1;
+    len = frame_payload(node, ch, start, iov);
+  }
+
+  return skip_read(iov, len, rx_offset[ch]);
+}
+
+static const mpb_frame_t *head_frame(int node, int ch)
+{
+  int start;
+  rx_batch_t *batch;
+
+  if ((batch = batch_head(node, ch)) != NULL) return &batch->frame;
+
+  start = START(node, ch);
+  if (start == END(node, ch)) return NULL;
+
+  return (const mpb_frame_t*) (B_CHANNEL(node, ch) + start);
+}
+
+/* Header of the head frame on the selected channel, NULL while it is empty. */
+const mpb_frame_t *mpb_peek_frame(int node)
+{
+  flush();
+  return head_frame(node, rx_channel);
+}
 
-  while (size) {
-    if (end < start) cpy = min(size, B_SIZE - start);
-    else cpy = size;
+/* Like mpb_select, but only a channel whose head frame is of the given type
+ * is considered; other frames stay queued. */
+int mpb_select_type(int node, int type)
+{
+  int i, ch, spins;
+  const mpb_frame_t *frame;
+
+  while (true) {
+    for (spins = 0; spins < MPB_POLL_SPINS; spins++) {
+      flush();
+      for (i = 1; i <= MPB_CHANNELS; i++) {
+        ch = (rx_channel + i) % MPB_CHANNELS;
+        if ((frame = head_frame(node, ch)) != NULL && frame->type == type) return rx_channel = ch;
+      }
+    }
+
+    /* mpb_wait returns at once while other frames are queued. */
+    if (mpb_pending(node)) usleep(1);
+    else mpb_wait(node);
+  }
+}
+
+void mpb_consume(int node)
+{
+  int start, ch = rx_channel;
+  const mpb_frame_t *frame;
+  rx_batch_t *batch = &rx_batch[ch];
 
-    flush();
-    memcpy(dst, (void*) (mpbs[node] + B_START + start), cpy);
-    start = (start + cpy) % B_SIZE;
-    dst = ((char*) dst) + cpy;
-    size -= cpy;
+  rx_offset[ch] = 0;
+  if (batch->pos < batch->len) {
+    batch->pos += sizeof(mpb_sub_t) + ((const mpb_sub_t*) (batch->data + batch->pos))->len;
+    return;
   }
 
   flush();
-  START(node) = start;
+  start = START(node, ch);
+  frame = (const mpb_frame_t*) (B_CHANNEL(node, ch) + start);
+  count_rx(frame);
+
+  START(node, ch) = (start + FRAME_SIZE(frame->len)) % B_SIZE;
+  return_credits(node, ch, FRAME_SIZE(frame->len));
   FOOL_WRITE_COMBINE;
 }
 
-void cpy_mem_to_mpb(int node, void *src, int size)
+/* Hand the rest of the batch of channel ch to handler, one message at a
+ * time. */
+static int batch_drain(int ch, mpb_handler_t handler, void *arg)
+{
+  rx_batch_t *batch = &rx_batch[ch];
+  const mpb_sub_t *sub;
+  struct iovec iov[2] = { { NULL, 0 }, { NULL, 0 } };
+  int count = 0;
+
+  while (batch->pos < batch->len) {
+    sub = (const mpb_sub_t*) (batch->data + batch->pos);
+    batch->frame.len = sub->len;
+    batch->frame.type = sub->type;
+    iov[0].iov_base = (void*) (sub + 1);
+    iov[0].iov_len = sub->len;
+    skip_read(iov, sub->len, rx_offset[ch]);
+    rx_offset[ch] = 0;
+    handler(&batch->frame, iov, arg);
+    batch->pos += sizeof(mpb_sub_t) + sub->len;
+    count++;
+  }
+
+  return count;
+}
+
+/* Hand every frame that is currently in the own MPB to handler, one channel
+ * after the other, and release each channel's frames with one START update. */
+int mpb_drain(int node, mpb_handler_t handler, void *arg)
+{
+  int ch, start, end, bytes, count = 0;
+  struct iovec iov[2];
+  const mpb_frame_t *frame;
+
+  flush();
+  for (ch = 0; ch < MPB_CHANNELS; ch++) {
+    count += batch_drain(ch, handler, arg);
+
+    start = START(node, ch);
+    end = END(node, ch);
+    if (start == end) continue;
+
+    bytes = 0;
+    while (start != end) {
+      frame = (const mpb_frame_t*) (B_CHANNEL(node, ch) + start);
+      if (frame->type == MPB_MSG_BATCH) {
+        batch_load(node, ch, start);
+        count += batch_drain(ch, handler, arg);
+      } else {
+        skip_read(iov, frame_payload(node, ch, start, iov), rx_offset[ch]);
+        rx_offset[ch] = 0;
+        handler(frame, iov, arg);
+        count++;
+      }
+      count_rx(frame);
+      bytes += FRAME_SIZE(frame->len);
+      start = (start + FRAME_SIZE(frame->len)) % B_SIZE;
+    }
+
+    START(node, ch) = start;
+    return_credits(node, ch, bytes);
+    FOOL_WRITE_COMBINE;
+  }
+
+  return count;
+}
+
+/* Copy the payload of the next frame on the selected channel to dst, waiting
+ * for it if necessary. At most size bytes are copied; the rest of a longer
+ * payload is left for the next call. */
+void cpy_mpb_to_mem(int node, void *dst, int size)
 {
-  int start, end, free;
+  struct iovec iov[2];
+  int len;
+
+  while ((len = mpb_peekv(node, iov)) < 0) mpb_wait(node);
+
+  size = min(size, len);
+  get_lines(dst, iov[0].iov_base, min(size, iov[0].iov_len));
+  if (size > iov[0].iov_len) {
+    get_lines((char*) dst + iov[0].iov_len, iov[1].iov_base, size - iov[0].iov_len);
+  }
+
+  /* A short read leaves the rest of the message for the next one. */
+  if (size < len) rx_offset[rx_channel] += size;
+  else mpb_consume(node);
+}
+
+/* Copy size bytes into the ring of channel ch at pos, wrapping at the end. */
+static int put_ring(int node, int ch, int pos, const void *src, int size)
+{
+  int cpy = min(size, B_SIZE - pos);
+
+  memcpy_put((void*) (B_CHANNEL(node, ch) + pos), src, cpy);
+  if (size > cpy) memcpy_put((void*) B_CHANNEL(node, ch), (const char*) src + cpy, size - cpy);
+
+  return (pos + size) % B_SIZE;
+}
 
-  if (size >= B_SIZE) {
+/* Copy the n segments into the ring from the line at pos on. Whole lines go
+ * straight from the segments, the bytes around them through a line buffer,
+ * so memcpy_put only writes whole lines. */
+static void put_lines(int node, int ch, int pos, const struct iovec *iov, int n)
+{
+  char line[MPB_LINE_SIZE];
+  const char *src;
+  int i, cpy, size, fill = 0;
+
+  for (i = 0; i < n; i++) {
+    src = iov[i].iov_base;
+    size = iov[i].iov_len;
+
+    while (size > 0) {
+      if (fill == 0 && size >= MPB_LINE_SIZE) {
+        cpy = size & ~(MPB_LINE_SIZE - 1);
+        pos = put_ring(node, ch, pos, src, cpy);
+      } else {
+        cpy = min(size, MPB_LINE_SIZE - fill);
+        memcpy(line + fill, src, cpy);
+        fill += cpy;
+        if (fill == MPB_LINE_SIZE) {
+          pos = put_ring(node, ch, pos, line, MPB_LINE_SIZE);
+          fill = 0;
+        }
+      }
+      src += cpy;
+      size -= cpy;
+    }
+  }
+
+  if (fill) put_ring(node, ch, pos, line, MPB_LINE_SIZE);
+}
+
+/* Free bytes in the own channel at node and its end. Senders with credits
+ * only read their own MPB. */
+static int ring_room(int node, int ch, int *end)
+{
+  flush();
+  if (CREDITED(node_location, node)) {
+    *end = tx_end[node];
+    return B_SIZE - 1 - (int) (tx_sent[node] - CREDIT(node_location, node));
+  }
+
+  *end = END(node, ch);
+  return (START(node, ch) - *end - 1 + B_SIZE) % B_SIZE;
+}
+
+int mpb_credits(int node)
+{
+  int end, room = ring_room(node, CHANNEL(node_location), &end);
+
+  room = (room & ~(MPB_LINE_SIZE - 1)) - MPB_LINE_SIZE;
+  return room > 0 ? min(room, MPB_MAX_PAYLOAD) : 0;
+}
+
+static void dest_init(void)
+{
+  int node;
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  for (node = 0; node < CORES; node++) pthread_mutex_init(&dest_lock[node], &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+/* Hold the sends to node; without block give up with false instead of
+ * waiting. */
+static bool hold_dest(int node, bool block)
+{
+  pthread_once(&dest_once, dest_init);
+
+  if (block) pthread_mutex_lock(&dest_lock[node]);
+  else if (pthread_mutex_trylock(&dest_lock[node])) return false;
+
+  if (dest_depth[node]++ == 0 && CHANNEL(node_location) == SHARED_CHANNEL) {
+    if (block) {
+      lock(node);
+    } else if (!trylock(node)) {
+      dest_depth[node]--;
+      pthread_mutex_unlock(&dest_lock[node]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void release_dest(int node)
+{
+  if (--dest_depth[node] == 0 && CHANNEL(node_location) == SHARED_CHANNEL) unlock(node);
+  pthread_mutex_unlock(&dest_lock[node]);
+}
+
+void mpb_lock_dest(int node)
+{
+  hold_dest(node, true);
+}
+
+bool mpb_trylock_dest(int node)
+{
+  return hold_dest(node, false);
+}
+
+void mpb_unlock_dest(int node)
+{
+  release_dest(node);
+}
+
+/* Send the n segments as one frame of the given type: the space for the
+ * whole frame is reserved at once and END is published only after the last
+ * byte has been written, so a receiver never observes part of the message.
+ * Without block it gives up with -1 instead of waiting for the lock or for
+ * room. */
+static int send_frame(int node, int type, const struct iovec *iov, int n, bool block)
+{
+  int i, end, pos, size = 0, ch = CHANNEL(node_location);
+  union {
+    mpb_frame_t frame;
+    char line[MPB_LINE_SIZE];
+  } head;
+  bool stalled = false;
+  struct timespec since, now;
+  uint64_t waited;
+
+  for (i = 0; i < n; i++) size += iov[i].iov_len;
+
+  if (size > MPB_MAX_PAYLOAD) {
     printf("Message to big!");
     exit(3);
   }
 
-  flush();
-  WRITING(node) = true;
-  FOOL_WRITE_COMBINE;
+  if (!hold_dest(node, block)) return -1;
 
-  while (size) {
-    flush();
-    start = START(node);
-    end = END(node);
+  /* A refused try leaves a begin behind that the next send overrides. */
+  TRACE(TRACE_SEND_BEGIN, node, tx_seq[node], size);
 
-    if (end < start) free = start - end - 1;
-    else free = B_SIZE - end - (start == 0 ? 1 : 0);
-    free = min(free, size);
+  while (ring_room(node, ch, &end) < FRAME_SIZE(size)) {
+    if (!block) {
+      release_dest(node);
+      return -1;
+    }
+
+    if (!stalled) {
+      clock_gettime(CLOCK_MONOTONIC, &since);
+      stalled = true;
+    }
 
-    if (!free) {
-      unlock(node);
+    /* Let others in while waiting, unless in the middle of a message. */
+    if (dest_depth[node] == 1) {
+      release_dest(node);
+      usleep(1);
+      hold_dest(node, true);
+    } else {
       usleep(1);
-      lock(node);
-      continue;
     }
+  }
+
+  if (stalled) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    waited = (now.tv_sec - since.tv_sec) * 1000000000ull + now.tv_nsec - since.tv_nsec;
+    scc_stats_event(&scc_stats->stalls, &scc_stats->stall_ns, waited);
+    TRACE(TRACE_STALL, node, waited / 1000, size);
+  }
+
+  WRITING(node, ch) = true;
+  FOOL_WRITE_COMBINE;
+
+  if (DEBUG) printf("mpb_sendv: node: %d channel: %d end: %d segments: %d size: %d\n", node, ch, end, n, size);
+
+  head.frame.len = size;
+  head.frame.type = type;
+  head.frame.sender = node_location;
+  head.frame.seq = tx_seq[node]++;
+  pos = put_ring(node, ch, end, head.line, MPB_LINE_SIZE);
+  put_lines(node, ch, pos, iov, n);
+
+  flush();
+  END(node, ch) = (end + FRAME_SIZE(size)) % B_SIZE;
+  WRITING(node, ch) = false;
+  FOOL_WRITE_COMBINE;
+
+  tx_sent[node] += FRAME_SIZE(size);
+  tx_end[node] = (end + FRAME_SIZE(size)) % B_SIZE;
+
+  scc_stats_tx(node, size);
+  TRACE(TRACE_SEND_END, node, head.frame.seq, size);
+
+  flush();
+  if (SLEEPING(node)) mpb_ring(node);
 
-//    memcpy((void*) (mpbs[node] + B_START + end), src, free);
+  release_dest(node);
+  return 0;
+}
+
+void mpb_sendv(int node, int type, const struct iovec *iov, int n)
+{
+  send_frame(node, type, iov, n, true);
+}
+
+int mpb_try_sendv(int node, int type, const struct iovec *iov, int n)
+{
+  return send_frame(node, type, iov, n, false);
+}
+
+void cpy_mem_to_mpbv(int node, const struct iovec *iov, int n)
+{
+  mpb_sendv(node, MPB_MSG_DATA, iov, n);
+}
 
-//cpy_mem_to_mpb
-	printf("memcpy_put:\n node: %d B_START+end: %d src: %s size: %d\n", node,B_START + end,src,free);
-	memcpy_put((void*) (mpbs[node] + B_START + end), src, free);
+void cpy_mem_to_mpb(int node, void *src, int size)
+{
+  struct iovec iov = { src, size };
+
+  mpb_sendv(node, MPB_MSG_DATA, &iov, 1);
+}
+
+/* Number of the current collective; flags and lines of older ones hold
+ * smaller values. Barriers and reductions count separately. */
+static uint32_t bar_epoch, coll_epoch;
+
+static void coll_spin(int *spins)
+{
+  if (++*spins == MPB_POLL_SPINS) {
+    usleep(1);
+    *spins = 0;
+  }
+  flush();
+}
+
+/* Write a value into a line of another MPB once the previous one has been
+ * taken; the epoch goes last. */
+static void coll_put(volatile coll_line_t *line, const void *data, int size, uint32_t epoch)
+{
+  int spins = 0;
+
+  for (flush(); line->taken != line->epoch; coll_spin(&spins));
+
+  memcpy_put((void*) line->data, data, size);
+  flush();
+  line->epoch = epoch;
+  FOOL_WRITE_COMBINE;
+}
+
+/* Wait for the value of the given collective in a line of the own MPB. */
+static void coll_take(volatile coll_line_t *line, void *data, int size, uint32_t epoch)
+{
+  int spins = 0;
 
-    flush();
-    size -= free;
-    src += free;
-    END(node) = (end + free) % B_SIZE;
-    WRITING(node) = false;
+  for (flush(); (int32_t) (line->epoch - epoch) < 0; coll_spin(&spins));
+
+  memcpy_get(data, (void*) line->data, size);
+  line->taken = epoch;
+  FOOL_WRITE_COMBINE;
+}
+
+void scc_barrier(void)
+{
+  int r, spins, n = topology.active_nodes;
+  uint32_t epoch = ++bar_epoch;
+
+  for (r = 0; 1 << r < n; r++) {
+    BAR_FLAG((node_location + (1 << r)) % n, r) = epoch;
     FOOL_WRITE_COMBINE;
+
+    spins = 0;
+    for (flush(); (int32_t) (BAR_FLAG(node_location, r) - epoch) < 0; coll_spin(&spins));
+  }
+}
+
+/* Binomial tree rooted at root over the ranks relative to it: the children
+ * of a rank come in at the rounds below its lowest set bit, and the value
+ * goes up at that bit. Returns the parent, or -1 at the root. */
+static int coll_up(void *acc, int size, scc_reduce_op_t op, int root, uint32_t epoch)
+{
+  int r, n = topology.active_nodes, rank = (node_location - root + n) % n;
+  uint8_t in[COLL_MAX_PAYLOAD];
+
+  for (r = 0; 1 << r < n; r++) {
+    if (rank & 1 << r) {
+      int parent = (rank - (1 << r) + root) % n;
+
+      coll_put(COLL_SLOT(parent, r), acc, size, epoch);
+      return parent;
+    }
+
+    if (rank + (1 << r) < n) {
+      coll_take(COLL_SLOT(node_location, r), in, size, epoch);
+      op(acc, in, size);
+    }
+  }
+
+  return -1;
+}
+
+void scc_reduce(const void *in, void *out, int size, scc_reduce_op_t op, int root)
+{
+  uint8_t acc[COLL_MAX_PAYLOAD];
+
+  if (size > COLL_MAX_PAYLOAD) {
+    printf("Reduction payload too big!");
+    exit(3);
   }
+
+  memcpy(acc, in, size);
+  if (coll_up(acc, size, op, root, ++coll_epoch) < 0) memcpy(out, acc, size);
 }
 
+void scc_allreduce(const void *in, void *out, int size, scc_reduce_op_t op)
+{
+  int r, n = topology.active_nodes;
+  uint32_t epoch = ++coll_epoch;
+  uint8_t acc[COLL_MAX_PAYLOAD];
+
+  if (size > COLL_MAX_PAYLOAD) {
+    printf("Reduction payload too big!");
+    exit(3);
+  }
+
+  memcpy(acc, in, size);
+
+  /* Up to node 0 and back down the same tree: a node passes the result on
+   * to its children from the highest round down. */
+  if (coll_up(acc, size, op, 0, epoch) >= 0) {
+    coll_take(COLL_DOWN(node_location), acc, size, epoch);
+  }
+
+  for (r = 0; 1 << r < n && !(node_location & 1 << r); r++);
+  while (--r >= 0) {
+    if (node_location + (1 << r) < n) coll_put(COLL_DOWN(node_location + (1 << r)), acc, size, epoch);
+  }
+
+  memcpy(out, acc, size);
+}
+
+#define REDUCE_OP(name, type, expr) \
+  void name(void *acc, const void *in, int size) \
+  { \
+    type *a = acc; \
+    const type *b = in; \
+    int i; \
+    for (i = 0; i < size / (int) sizeof(type); i++) a[i] = expr; \
+  }
+
+REDUCE_OP(scc_sum_int, int, a[i] + b[i])
+REDUCE_OP(scc_min_int, int, a[i] < b[i] ? a[i] : b[i])
+REDUCE_OP(scc_max_int, int, a[i] > b[i] ? a[i] : b[i])
+REDUCE_OP(scc_sum_double, double, a[i] + b[i])
+REDUCE_OP(scc_min_double, double, a[i] < b[i] ? a[i] : b[i])
+REDUCE_OP(scc_max_double, double, a[i] > b[i] ? a[i] : b[i])
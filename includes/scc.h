@@ -4,12 +4,17 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "../config.h"
 #include "bool.h"
+#include "sccstats.h"
+#include "scctrace.h"
 
 
-#define PAGE_SIZE           (16*1024*1024)
+/* PAGES_PER_CORE, MAX_PAGES, CORES and DLPEL_ACTIVE_NODES are the defaults
+ * and upper bounds of the runtime topology, see scc_topology_t. */
+#define PAGE_SIZE           ((size_t) 16*1024*1024)
 #define LINUX_PRIV_PAGES    (20)
 #define PAGES_PER_CORE      (41)
 #define MAX_PAGES           (172)
@@ -19,12 +24,85 @@
 
 #define B_OFFSET            64
 #define FOOL_WRITE_COMBINE  (mpbs[node_location][0] = 1)
-#define START(i)            (*((volatile uint16_t *) (mpbs[i] + B_OFFSET)))
-#define END(i)              (*((volatile uint16_t *) (mpbs[i] + B_OFFSET + 2)))
 #define HANDLING(i)         (*(mpbs[i] + B_OFFSET + 4))
-#define WRITING(i)          (*(mpbs[i] + B_OFFSET + 5))
-#define B_START             (B_OFFSET + 32)
-#define B_SIZE              (MPBSIZE - B_START)
+#define SLEEPING(i)         (*(mpbs[i] + B_OFFSET + 6))
+
+/* Reader counts of the broadcasts a node has in flight, in the second line
+ * of its MPB; readers decrement them under the node's CRB lock. */
+#define BCAST_OFFSET        32
+#define BCAST_SLOTS         16
+#define BCAST_COUNT(i, s)   (*((volatile uint16_t *) (mpbs[i] + BCAST_OFFSET + 2 * (s))))
+
+/* A receiver polls its channels MPB_POLL_SPINS times before it sleeps on its
+ * doorbell; the wait is bounded by MPB_SLEEP_US in case a ring got lost. */
+#define MPB_POLL_SPINS      1000
+#define MPB_SLEEP_US        1000
+
+/* The receive buffer is split into MPB_CHANNELS single-producer rings, one per
+ * active node. Any other sender shares the last channel under the CRB lock of
+ * the destination. Each channel has its own control line. The layout depends
+ * on the number of active nodes and is computed by scc_topology_init. */
+#define MPB_CHANNELS        mpb_channels
+#define SHARED_CHANNEL      (MPB_CHANNELS - 1)
+#define CHANNEL(sender)     ((sender) < SHARED_CHANNEL ? (sender) : SHARED_CHANNEL)
+#define C_OFFSET(ch)        (B_OFFSET + 32 + (ch) * MPB_LINE_SIZE)
+#define START(i, ch)        (*((volatile uint16_t *) (mpbs[i] + C_OFFSET(ch))))
+#define END(i, ch)          (*((volatile uint16_t *) (mpbs[i] + C_OFFSET(ch) + 2)))
+#define WRITING(i, ch)      (*(mpbs[i] + C_OFFSET(ch) + 4))
+
+/* The collectives have a flag area of their own after the control lines.
+ * Line 0 holds the dissemination barrier flags, one per round and each
+ * written by a single peer; the next COLL_ROUNDS lines take the values of
+ * the reduction children, one per round, and the last one the allreduce
+ * result from the parent. Flags and lines carry the number of the
+ * collective they belong to, so they are never reset. A line is written
+ * only once its owner has marked the previous value as taken. */
+#define COLL_ROUNDS         6
+#define COLL_LINES          (COLL_ROUNDS + 2)
+#define COLL_MAX_PAYLOAD    (MPB_LINE_SIZE - 8)
+#define F_OFFSET            C_OFFSET(MPB_CHANNELS)
+#define BAR_FLAG(i, r)      (*((volatile uint32_t *) (mpbs[i] + F_OFFSET + 4 * (r))))
+#define COLL_SLOT(i, r)     ((volatile coll_line_t *) (mpbs[i] + F_OFFSET + MPB_LINE_SIZE * (1 + (r))))
+#define COLL_DOWN(i)        COLL_SLOT(i, COLL_ROUNDS)
+
+/* Credits for the single-producer channels live in the spare bytes of the
+ * control lines, so they take no room from the rings. The word in control
+ * line r of node i counts the bytes receiver r has consumed from i's channel
+ * in its MPB (modulo 2^32) and is written only by r, right after it advanced
+ * START. With its own count of the bytes sent, a sender knows the free room
+ * of the ring from its own MPB instead of polling the receiver's control
+ * line. Only nodes with their own channel exchange credits; the shared
+ * channel still reads the ring state under the lock. */
+#define CREDIT(i, r)        (*((volatile uint32_t *) (mpbs[i] + C_OFFSET(r) + 8)))
+#define CREDITED(s, r)      ((s) < SHARED_CHANNEL && (r) < SHARED_CHANNEL)
+
+/* The startup handshake of mpb_start uses the next word: in control line r
+ * of node 0 the echo of node r, in control line 0 of node r the token. */
+#define HELLO(i, r)         (*((volatile uint32_t *) (mpbs[i] + C_OFFSET(r) + 12)))
+
+#define B_START             (F_OFFSET + COLL_LINES * MPB_LINE_SIZE)
+#define B_SIZE              mpb_ring_size
+#define B_CHANNEL(i, ch)    (mpbs[i] + B_START + (ch) * B_SIZE)
+
+/* Every message in a channel is a frame: a line holding the mpb_frame_t
+ * header, followed by the payload padded to whole MPB lines. Frames and
+ * payloads start on a line, so memcpy_put and memcpy_get move whole lines. */
+#define MPB_MSG_DATA        0
+#define MPB_MSG_REMAP       1
+#define MPB_MSG_RECORD      2
+#define MPB_MSG_INLINE      3
+#define MPB_MSG_STREAM      4
+#define MPB_MSG_BCAST       5
+#define MPB_MSG_BATCH       6
+#define FRAME_SIZE(len)     (MPB_LINE_SIZE + (((len) + MPB_LINE_SIZE - 1) & ~(MPB_LINE_SIZE - 1)))
+#define MPB_MAX_PAYLOAD     (B_SIZE - 2 * MPB_LINE_SIZE)
+
+/* A batch frame carries small messages of other types back to back, each
+ * behind an mpb_sub_t, in at most MPB_BATCH_MAX bytes. The receiver copies
+ * a batch out of the ring as soon as it reaches the head of its channel and
+ * serves the messages as frames of their own, with the sequence number of
+ * the batch. */
+#define MPB_BATCH_MAX       512
 
 #define LUT(loc, idx)       (*((volatile uint32_t*)(&luts[loc][idx])))
 
@@ -33,6 +111,7 @@
 #define DLPEL_ACTIVE_NODES			4	
 #define DLPEL_SUCCESS                   	0
 //#define MPB_LINE_SIZE                     	5
+#define LOG2_LINE_SIZE                      5
 #define MPB_LINE_SIZE                     	(1<<LOG2_LINE_SIZE)
 // RCCE_BUFF_SIZE_MAX is space per UE, which is half of the space per tile
 #define MPB_BUFF_SIZE_MAX                   (1<<13)
@@ -47,6 +126,46 @@
 
 //added by Simon end
 
+typedef struct {
+  uint16_t len;
+  uint8_t type;
+  uint8_t sender;
+  uint32_t seq;
+} mpb_frame_t;
+
+typedef struct {
+  uint8_t len;
+  uint8_t type;
+} mpb_sub_t;
+
+typedef struct {
+  uint32_t epoch, taken;
+  uint8_t data[COLL_MAX_PAYLOAD];
+} coll_line_t;
+
+/* Combines the size bytes at in into acc; must be associative and
+ * commutative. */
+typedef void (*scc_reduce_op_t)(void *acc, const void *in, int size);
+
+typedef void (*mpb_handler_t)(const mpb_frame_t *frame, const struct iovec *payload, void *arg);
+
+/* Topology of the job. scc_topology_init starts from the compile-time
+ * defaults, applies the "key = value" lines of the file named by SCC_TOPOLOGY
+ * and then the environment variables SCC_ACTIVE_NODES, SCC_CORES,
+ * SCC_PAGES_PER_CORE and SCC_MAX_PAGES. All nodes must see the same values.
+ * active_nodes cores run a node, the pages of the other cores up to cores are
+ * borrowed; pages_per_core pages per core, max_pages per node (local plus
+ * remote window). */
+typedef struct {
+  int active_nodes;
+  int cores;
+  int pages_per_core;
+  int max_pages;
+} scc_topology_t;
+
+extern scc_topology_t topology;
+extern int mpb_channels, mpb_ring_size;
+
 extern bool remap;
 extern int node_location;
 
@@ -58,16 +177,83 @@ extern volatile uint64_t *luts[CORES];
 
 static inline int min(int x, int y) { return x < y ? x : y; }
 
+#ifdef SCC_EMU
+/* The emulated MPB is coherent memory; a full barrier orders the accesses. */
+static inline void flush() { __sync_synchronize(); }
+
+/* Emulated lock registers hold 1 while taken and are acquired atomically. */
+static inline void lock(int core) { while (__sync_lock_test_and_set(locks[core], 1)); }
+
+static inline bool trylock(int core) { return !__sync_lock_test_and_set(locks[core], 1); }
+
+static inline void unlock(int core) { __sync_lock_release(locks[core]); }
+#else
 /* Flush MPBT from L1. */
 static inline void flush() { __asm__ volatile ( ".byte 0x0f; .byte 0x0a;\n" ); }
 
 static inline void lock(int core) { while (!(*locks[core] & 0x01)); }
 
+/* A read of the lock register takes the lock if it is free. */
+static inline bool trylock(int core) { return *locks[core] & 0x01; }
+
 static inline void unlock(int core) { *locks[core] = 0; }
+#endif
+
 
+void scc_topology_init(void);
+void mpb_init(int node);
 
+/* Wait until every active node has run mpb_init, so that no frame or flag
+ * lands in an MPB that is still going to be reset. Called by scc_init. */
+void mpb_start(void);
+void mpb_ring(int node);
+void mpb_wait(int node);
+int mpb_select(int node);
+int mpb_select_from(int node, int sender);
+int mpb_select_type(int node, int type);
+int mpb_peek(int node, void **ptr, int *len);
+int mpb_peekv(int node, struct iovec *iov);
+const mpb_frame_t *mpb_peek_frame(int node);
+void mpb_consume(int node);
+int mpb_drain(int node, mpb_handler_t handler, void *arg);
 void cpy_mpb_to_mem(int node, void *dst, int size);
+void mpb_sendv(int node, int type, const struct iovec *iov, int n);
+
+/* A message of several frames to node holds its sends from the first frame
+ * to the last, so that no frame of another thread (nor of the send queue)
+ * gets in between; the receiver reads them back to back from the sender's
+ * channel. Holds nest; mpb_try_sendv to a node held by another thread
+ * refuses, and so does mpb_trylock_dest, which returns false instead of
+ * waiting. */
+void mpb_lock_dest(int node);
+bool mpb_trylock_dest(int node);
+void mpb_unlock_dest(int node);
 void cpy_mem_to_mpb(int node, void *src, int size);
+void cpy_mem_to_mpbv(int node, const struct iovec *iov, int n);
+
+/* Non-blocking sends. mpb_credits returns the largest payload a frame to node
+ * can carry right now without waiting (0 if none); with credits this is a
+ * read of the own MPB, on the shared channel only a snapshot. mpb_try_sendv
+ * sends like mpb_sendv if the frame fits and the locks are free, and returns -1
+ * without sending otherwise. */
+int mpb_credits(int node);
+int mpb_try_sendv(int node, int type, const struct iovec *iov, int n);
+
+/* Collectives over all active nodes, which must call them in the same
+ * order. Payloads are at most COLL_MAX_PAYLOAD bytes. The barrier is a
+ * dissemination barrier, reduce and allreduce use a binomial tree (the
+ * result of allreduce travels back down the same tree). */
+void scc_barrier(void);
+void scc_reduce(const void *in, void *out, int size, scc_reduce_op_t op, int root);
+void scc_allreduce(const void *in, void *out, int size, scc_reduce_op_t op);
+
+/* Element-wise operations on int and double arrays. */
+void scc_sum_int(void *acc, const void *in, int size);
+void scc_min_int(void *acc, const void *in, int size);
+void scc_max_int(void *acc, const void *in, int size);
+void scc_sum_double(void *acc, const void *in, int size);
+void scc_min_double(void *acc, const void *in, int size);
+void scc_max_double(void *acc, const void *in, int size);
 
 #endif /*SCC_H*/
 
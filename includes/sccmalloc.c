@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
 #include "memfun.h"
@@ -11,6 +12,9 @@
 #include "sccmalloc.h"
 #include "bool.h"
 #include "configuration.h"
+#ifdef SCC_EMU
+#include "../sccemu.h"
+#endif
 
 
 
@@ -24,10 +28,54 @@ typedef union block {
   uint32_t align;   // Forces proper allignment
 } block_t;
 
+/* Remote LUT entries are tracked in a bitmap with one bit per entry (set
+ * while in use, padding bits at the end are always set). lutRun holds the
+ * length of each allocated run at its first entry, lutRefs the number of
+ * SCCMapLut callers that still have to free a mapped run. */
+#define LUT_WORDS      ((MAX_PAGES + 31) / 32)
+
+/* Runs mapped by SCCMapLut are cached by origin (node, first LUT entry).
+ * Released runs stay mapped until their slot or their LUT entries are
+ * needed, so repeated transfers from a hot remote buffer need neither a LUT
+ * rewrite nor a run allocation. A stale mapping leaves the cache at once but
+ * its run lives on until the last holder frees it. */
+#define MAP_CACHE_SIZE 16
+
 typedef struct {
-  unsigned char free;
-  unsigned char size;
-} lut_state_t;
+  unsigned char node, lut, count, local;
+  unsigned int used;
+} lut_map_t;
+
+/* Requests of up to SMALL_UNITS blocks (header included) are rounded up to
+ * one of the size classes below and served from a free list per class. The
+ * class lists are refilled CHUNK_SIZE bytes at a time from the first-fit list
+ * of page runs, which serves all larger requests directly. Small blocks are
+ * tagged by SMALL_BLOCK in their size field, which then holds the class. */
+#define SMALL_CLASSES  15
+#define SMALL_UNITS    256
+#define SMALL_BLOCK    ((size_t) 1 << (sizeof(size_t) * 8 - 1))
+#define CHUNK_SIZE     (64 * 1024)
+
+static const size_t classUnits[SMALL_CLASSES] = {
+  2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256
+};
+
+/* Each thread allocates small blocks from its own cache, which holds up to
+ * CACHE_MAX blocks per class and trades CACHE_BATCH blocks at a time with the
+ * shared class lists. An allocated small block records its cache in the
+ * header's next field; a block freed by another thread is pushed onto that
+ * cache's lock-free remote list and reclaimed by the owner when it runs dry.
+ * Caches of exited threads are handed on to new threads. heapLock protects
+ * the page runs, the shared class lists and the list of unused caches. */
+#define CACHE_MAX      64
+#define CACHE_BATCH    32
+
+typedef struct cache {
+  block_t *list[SMALL_CLASSES];
+  int count[SMALL_CLASSES];
+  block_t *volatile remote;
+  struct cache *next;
+} cache_t;
 
 void *remote;
 unsigned char local_pages;
@@ -35,7 +83,20 @@ unsigned char local_pages;
 static void *local;
 static int mem, cache;
 static block_t *freeList;
-static lut_state_t *lutState;
+static block_t *classList[SMALL_CLASSES];
+static unsigned char unitClass[SMALL_UNITS + 1];
+static pthread_mutex_t heapLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t cacheKey;
+static __thread cache_t *threadCache;
+static cache_t *unusedCaches;
+static uint32_t lutUsed[LUT_WORDS];
+static unsigned char *lutRun;
+static unsigned int *lutRefs;
+static lut_stats_t lutStats;
+static pthread_mutex_t lutLock = PTHREAD_MUTEX_INITIALIZER;
+static lut_map_t mapCache[MAP_CACHE_SIZE];
+static unsigned int mapClock;
 static unsigned char remote_pages;
 
 lut_addr_t SCCPtr2Addr(void *p)
@@ -72,9 +133,17 @@ void *SCCAddr2Ptr(lut_addr_t addr)
 
 void SCCInit(unsigned char size)
 {
-  local_pages = size;
-  remote_pages = remap ? MAX_PAGES - size : 1;
+  int i, cls;
 
+  local_pages = size;
+  remote_pages = remap ? topology.max_pages - size : COPY_SLOTS;
+
+#ifdef SCC_EMU
+  /* Map the emulated DRAM pages through the current LUT entries */
+  mem = cache = -1;
+  local = EmuMapPages(NULL, &luts[node_location][LOCAL_LUT], local_pages);
+  remote = EmuMapPages(NULL, &luts[node_location][REMOTE_LUT], remote_pages);
+#else
   /* Open driver device "/dev/rckdyn011" to map memory in write-through mode */
   mem = open("/dev/rckdyn011", O_RDWR|O_SYNC);
   printf("mem: %i\n", mem);
@@ -91,39 +160,107 @@ void SCCInit(unsigned char size)
 
   remote = mmap(NULL, remote_pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, mem, REMOTE_LUT << 24);
   if (remote == NULL) printf("Couldn't map memory!");
+#endif
 
   freeList = local;
   freeList->hdr.next = freeList;
   freeList->hdr.size = (size * PAGE_SIZE) / sizeof(block_t);
 
+  for (i = 0, cls = 0; i <= SMALL_UNITS; i++) {
+    if (i > classUnits[cls]) cls++;
+    unitClass[i] = cls;
+  }
+  memset(classList, 0, sizeof(classList));
+
   if (remap) {
-    lutState = SNetMemAlloc(remote_pages * sizeof(lut_state_t));
-    lutState[0].free = 1;
-    lutState[0].size = remote_pages;
-    lutState[remote_pages - 1] = lutState[0];
+    lutRun = SNetMemAlloc(remote_pages);
+    memset(lutRun, 0, remote_pages);
+    lutRefs = SNetMemAlloc(remote_pages * sizeof(unsigned int));
+    memset(lutRefs, 0, remote_pages * sizeof(unsigned int));
+    memset(lutUsed, 0, sizeof(lutUsed));
+    for (i = remote_pages; i < LUT_WORDS * 32; i++) lutUsed[i / 32] |= 1u << (i % 32);
+    memset(&lutStats, 0, sizeof(lutStats));
+    memset(mapCache, 0, sizeof(mapCache));
   }
 }
 
 void SCCStop(void)
 {
+  scc_stats_flush();
   munmap(remote, remote_pages * PAGE_SIZE);
   munmap(local, local_pages * PAGE_SIZE);
 
+#ifndef SCC_EMU
   close(mem);
   close(cache);
+#endif
 }
 
-void *SCCMallocPtr(size_t size)
+void SCCSyncLut(unsigned char lut, unsigned char count)
+{
+  scc_stats_event(&scc_stats->lut_remaps, &scc_stats->lut_remap_pages, count);
+
+#ifdef SCC_EMU
+  /* The emulation resolves LUT entries at mmap time, so remap the pages */
+  EmuMapPages(remote + (lut - REMOTE_LUT) * PAGE_SIZE, &luts[node_location][lut], count);
+#endif
+}
+
+int SCCRemapPlan(int node, int cores, int active, int pages_per_core, int priv_pages, int max_pages,
+                 lut_remap_t *plan)
+{
+  int i, src, lut, count = 0, pages = pages_per_core - priv_pages;
+  int rounds = cores / active, extra = ((cores % active) * pages_per_core) / active;
+
+  /* Every active core takes all pages of the cores node + i * active. */
+  for (i = 1; i < rounds && pages < max_pages; i++) {
+    for (lut = 0; lut < pages_per_core && pages < max_pages; lut++, count++) {
+      plan[count].lut = priv_pages + pages++;
+      plan[count].node = node + i * active;
+      plan[count].src = lut;
+    }
+  }
+
+  /* The pages of the cores left over by the division are shared out in
+   * equal slices of extra pages, in core order. */
+  src = rounds * active + (node * extra) / pages_per_core;
+  lut = (node * extra) % pages_per_core;
+  for (i = 0; i < extra && pages < max_pages; i++, count++) {
+    plan[count].lut = priv_pages + pages++;
+    plan[count].node = src;
+    plan[count].src = lut;
+
+    if (++lut == pages_per_core) {
+      lut = 0;
+      src++;
+    }
+  }
+
+  return count;
+}
+
+void SCCApplyRemap(const lut_remap_t *plan, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    LUT(node_location, plan[i].lut) = LUT(plan[i].node, plan[i].src);
+  }
+  flush();
+}
+
+static block_t *MallocBlocks(size_t nunits)
 {
-  size_t nunits;
   block_t *curr, *prev, *new;
 
 
-  if (freeList == NULL) printf("Couldn't allocate memory!");
+  if (freeList == NULL) {
+    printf("Couldn't allocate memory!");
+    return NULL;
+  }
 
   prev = freeList;
   curr = prev->hdr.next;
-  nunits = (size + sizeof(block_t) - 1) / sizeof(block_t) + 1;
 
   do {
     if (curr->hdr.size >= nunits) {
@@ -142,7 +279,7 @@ void *SCCMallocPtr(size_t size)
       	}
       }
       freeList = prev;
-      return (void*) (curr + 1);
+      return curr;
      }
   } while (curr != freeList && (prev = curr, curr = curr->hdr.next));
 
@@ -151,10 +288,9 @@ void *SCCMallocPtr(size_t size)
   return NULL;
 }
 
-void SCCFreePtr(void *p)
+static void FreeBlocks(block_t *block)
 {
-  block_t *block = (block_t*) p - 1,
-          *curr = freeList;
+  block_t *curr = freeList;
 
   if (freeList == NULL) {
     freeList = block;
@@ -170,8 +306,13 @@ void SCCFreePtr(void *p)
 
   if (block + block->hdr.size == curr->hdr.next) {
     block->hdr.size += curr->hdr.next->hdr.size;
-    if (curr == curr->hdr.next) block->hdr.next = block;
-    else block->hdr.next = curr->hdr.next->hdr.next;
+    if (curr == curr->hdr.next) {
+      /* The only free block was merged into block, curr is gone. */
+      block->hdr.next = block;
+      freeList = block;
+      return;
+    }
+    block->hdr.next = curr->hdr.next->hdr.next;
   } else {
     block->hdr.next = curr->hdr.next;
   }
@@ -186,52 +327,428 @@ void SCCFreePtr(void *p)
   freeList = curr;
 }
 
+/* Carve a chunk from the page runs into blocks of class cls. */
+static block_t *RefillClass(int cls)
+{
+  size_t units = classUnits[cls], count = CHUNK_SIZE / sizeof(block_t) / units, i;
+  block_t *chunk = MallocBlocks(count * units);
+
+  if (chunk == NULL) return NULL;
+
+  for (i = 0; i < count - 1; i++) {
+    chunk[i * units].hdr.next = chunk + (i + 1) * units;
+  }
+  chunk[i * units].hdr.next = NULL;
+
+  return chunk;
+}
+
+/* Move the cached blocks of a class beyond keep back to the shared list. */
+static void TrimCache(cache_t *c, int cls, int keep)
+{
+  block_t *block;
+
+  pthread_mutex_lock(&heapLock);
+  while (c->count[cls] > keep) {
+    block = c->list[cls];
+    c->list[cls] = block->hdr.next;
+    block->hdr.next = classList[cls];
+    classList[cls] = block;
+    c->count[cls]--;
+  }
+  pthread_mutex_unlock(&heapLock);
+}
+
+static void ReleaseCache(void *arg)
+{
+  cache_t *c = arg;
+  int cls;
+
+  for (cls = 0; cls < SMALL_CLASSES; cls++) TrimCache(c, cls, 0);
+
+  pthread_mutex_lock(&heapLock);
+  c->next = unusedCaches;
+  unusedCaches = c;
+  pthread_mutex_unlock(&heapLock);
+}
+
+static void CreateCacheKey(void)
+{
+  pthread_key_create(&cacheKey, ReleaseCache);
+}
+
+static cache_t *ThreadCache(void)
+{
+  cache_t *c = threadCache;
+
+  if (c != NULL) return c;
+
+  pthread_once(&cacheOnce, CreateCacheKey);
+
+  pthread_mutex_lock(&heapLock);
+  if ((c = unusedCaches) != NULL) unusedCaches = c->next;
+  pthread_mutex_unlock(&heapLock);
+
+  if (c == NULL) {
+    c = SNetMemAlloc(sizeof(cache_t));
+    memset(c, 0, sizeof(cache_t));
+  }
+
+  pthread_setspecific(cacheKey, c);
+  return threadCache = c;
+}
+
+/* Take over the blocks other threads have freed into this cache. */
+static void ReclaimRemote(cache_t *c)
+{
+  block_t *block, *next;
+  int cls;
+
+  if (c->remote == NULL) return;
+
+  for (block = __sync_lock_test_and_set(&c->remote, NULL); block != NULL; block = next) {
+    next = block->hdr.next;
+    cls = block->hdr.size & ~SMALL_BLOCK;
+    block->hdr.next = c->list[cls];
+    c->list[cls] = block;
+    c->count[cls]++;
+  }
+}
+
+/* Fetch up to CACHE_BATCH blocks of class cls from the shared list. */
+static void FillCache(cache_t *c, int cls)
+{
+  block_t *block;
+
+  pthread_mutex_lock(&heapLock);
+  if (classList[cls] == NULL) classList[cls] = RefillClass(cls);
+
+  while (classList[cls] != NULL && c->count[cls] < CACHE_BATCH) {
+    block = classList[cls];
+    classList[cls] = block->hdr.next;
+    block->hdr.next = c->list[cls];
+    c->list[cls] = block;
+    c->count[cls]++;
+  }
+  pthread_mutex_unlock(&heapLock);
+}
+
+void *SCCMallocPtr(size_t size)
+{
+  size_t nunits = (size + sizeof(block_t) - 1) / sizeof(block_t) + 1;
+  cache_t *c;
+  block_t *block;
+  int cls;
+
+  TRACE(TRACE_ALLOC, 0, size, 0);
+  if (nunits > SMALL_UNITS) {
+    pthread_mutex_lock(&heapLock);
+    block = MallocBlocks(nunits);
+    pthread_mutex_unlock(&heapLock);
+    if (block) scc_stats_heap(nunits * sizeof(block_t));
+    return block ? (void*) (block + 1) : NULL;
+  }
+
+  c = ThreadCache();
+  cls = unitClass[nunits];
+
+  if (c->list[cls] == NULL) ReclaimRemote(c);
+  if (c->list[cls] == NULL) FillCache(c, cls);
+  if (c->list[cls] == NULL) {
+    printf("Couldn't allocate memory!");
+    return NULL;
+  }
+
+  block = c->list[cls];
+  c->list[cls] = block->hdr.next;
+  c->count[cls]--;
+  block->hdr.next = (block_t*) c;
+  block->hdr.size = SMALL_BLOCK | cls;
+  scc_stats_heap(classUnits[cls] * sizeof(block_t));
+
+  return (void*) (block + 1);
+}
+
+void SCCFreePtr(void *p)
+{
+  block_t *block = (block_t*) p - 1;
+  cache_t *owner, *c;
+  int cls;
+
+  TRACE(TRACE_FREE, 0, 0, 0);
+  if (!(block->hdr.size & SMALL_BLOCK)) {
+    scc_stats_heap(-(long) (block->hdr.size * sizeof(block_t)));
+    pthread_mutex_lock(&heapLock);
+    FreeBlocks(block);
+    pthread_mutex_unlock(&heapLock);
+    return;
+  }
+
+  scc_stats_heap(-(long) (classUnits[block->hdr.size & ~SMALL_BLOCK] * sizeof(block_t)));
+  owner = (cache_t*) block->hdr.next;
+  c = ThreadCache();
+
+  if (owner != c) {
+    do {
+      block->hdr.next = owner->remote;
+    } while (!__sync_bool_compare_and_swap(&owner->remote, block->hdr.next, block));
+    return;
+  }
+
+  cls = block->hdr.size & ~SMALL_BLOCK;
+  block->hdr.next = c->list[cls];
+  c->list[cls] = block;
+  if (++c->count[cls] > CACHE_MAX) TrimCache(c, cls, CACHE_MAX - CACHE_BATCH);
+}
+
+/* Length of the stretch of equal bits starting at entry i, within its word. */
+static int LutStretch(int i, bool used)
+{
+  uint32_t bits = lutUsed[i / 32] >> (i % 32);
+  int n, left = 32 - i % 32;
+
+  if (used) bits = ~bits;
+  n = bits ? __builtin_ctz(bits) : left;
+
+  return min(n, left);
+}
+
+/* First-fit search for size free entries; skips whole words at a time. */
+static int LutFindRun(size_t size, int *largest)
+{
+  int i = 0, n, run = 0;
+
+  *largest = 0;
+  while (i < remote_pages) {
+    if (lutUsed[i / 32] >> (i % 32) & 1) {
+      run = 0;
+      i += LutStretch(i, true);
+    } else {
+      n = LutStretch(i, false);
+      run += n;
+      i += n;
+      if (run > *largest) *largest = run;
+      if (run >= size && size) return i - run;
+    }
+  }
+
+  return -1;
+}
+
+static void LutMark(int start, int size, bool used)
+{
+  int i;
+
+  for (i = start; i < start + size; i++) {
+    if (used) lutUsed[i / 32] |= 1u << (i % 32);
+    else lutUsed[i / 32] &= ~(1u << (i % 32));
+  }
+}
+
+static int LutAlloc(size_t size, int *largest)
+{
+  int start = LutFindRun(size, largest);
+
+  if (start < 0) return -1;
+
+  LutMark(start, size, true);
+  lutRun[start] = size;
+  lutStats.allocs++;
+  lutStats.live_runs++;
+  lutStats.used_entries += size;
+  scc_stats_lut(lutStats.used_entries);
+  return start;
+}
+
+static void LutRelease(int start)
+{
+  LutMark(start, lutRun[start], false);
+  lutStats.frees++;
+  lutStats.live_runs--;
+  lutStats.used_entries -= lutRun[start];
+  scc_stats_lut(lutStats.used_entries);
+  lutRun[start] = 0;
+  lutRefs[start] = 0;
+}
+
 unsigned char SCCMallocLut(size_t size)
 {
-  lut_state_t *curr = lutState;
+  int start, largest;
 
-  do {
-    if (curr->free && curr->size >= size) {
-      if (curr->size == size) {
-        curr->free = 0;
-        curr[size - 1].free = 0;
-      } else {
-        lut_state_t *next = curr + size;
-
-        next->free = 1;
-        next->size = curr->size - size;
-        next[next->size - 1] = next[0];
-
-        curr->free = 0;
-        curr->size = size;
-        curr[curr->size - 1] = curr[0];
-      }
+  pthread_mutex_lock(&lutLock);
+  start = LutAlloc(size, &largest);
+
+  if (start < 0) {
+    lutStats.failed++;
+    pthread_mutex_unlock(&lutLock);
+    printf("Not enough available LUT entries! (%u requested, largest free run %d)\n",
+           (unsigned int) size, largest);
+    return 0;
+  }
+
+  pthread_mutex_unlock(&lutLock);
+  return REMOTE_LUT + start;
+}
+
+/* Evict the least recently used mapping nobody references any more. */
+static bool MapEvict(void)
+{
+  lut_map_t *map, *victim = NULL;
+
+  for (map = mapCache; map < mapCache + MAP_CACHE_SIZE; map++) {
+    if (map->count && !lutRefs[map->local] && (!victim || map->used < victim->used)) victim = map;
+  }
+
+  if (victim == NULL) return false;
+
+  LutRelease(victim->local);
+  victim->count = 0;
+  return true;
+}
+
+/* A cached mapping is only reused while the origin's LUT entries still
+ * point at the pages that were copied. */
+static bool MapValid(lut_map_t *map)
+{
+  int i;
 
-      return REMOTE_LUT + curr - lutState;
+  for (i = 0; i < map->count; i++) {
+    if (LUT(node_location, REMOTE_LUT + map->local + i) != LUT(map->node, map->lut + i)) return false;
+  }
+
+  return true;
+}
+
+unsigned char SCCMapLut(unsigned char node, unsigned char lut, unsigned char count)
+{
+  lut_map_t *map, *slot = NULL;
+  int i, start, largest;
+
+  pthread_mutex_lock(&lutLock);
+
+  for (map = mapCache; map < mapCache + MAP_CACHE_SIZE; map++) {
+    if (!map->count || map->node != node || map->lut != lut || map->count < count) continue;
+
+    if (MapValid(map)) {
+      lutRefs[map->local]++;
+      map->used = ++mapClock;
+      lutStats.map_hits++;
+      pthread_mutex_unlock(&lutLock);
+      TRACE(TRACE_LUT_HIT, node, REMOTE_LUT + map->local, count);
+      return REMOTE_LUT + map->local;
+    }
+
+    /* Stale: drop it from the cache, a referenced run is freed by its last
+     * holder. */
+    if (!lutRefs[map->local]) LutRelease(map->local);
+    map->count = 0;
+  }
+
+  lutStats.map_misses++;
+  while ((start = LutAlloc(count, &largest)) < 0) {
+    if (!MapEvict()) {
+      lutStats.failed++;
+      pthread_mutex_unlock(&lutLock);
+      printf("Not enough available LUT entries! (%u requested, largest free run %d)\n", count, largest);
+      return 0;
     }
+  }
 
-    curr += curr->size;
-  } while (curr < lutState + remote_pages);
+  for (i = 0; i < count; i++) {
+    LUT(node_location, REMOTE_LUT + start + i) = LUT(node, lut + i);
+  }
+  SCCSyncLut(REMOTE_LUT + start, count);
+  lutRefs[start] = 1;
 
-  printf("Not enough available LUT entries!\n");
-  return 0;
+  for (map = mapCache; map < mapCache + MAP_CACHE_SIZE; map++) {
+    if (!map->count) {
+      slot = map;
+      break;
+    }
+    if (!lutRefs[map->local] && (!slot || map->used < slot->used)) slot = map;
+  }
+
+  if (slot != NULL) {
+    if (slot->count) LutRelease(slot->local);
+    slot->node = node;
+    slot->lut = lut;
+    slot->count = count;
+    slot->local = start;
+    slot->used = ++mapClock;
+  }
+
+  pthread_mutex_unlock(&lutLock);
+  TRACE(TRACE_LUT_MAP, node, REMOTE_LUT + start, count);
+  return REMOTE_LUT + start;
 }
 
-void SCCFreeLut(void *p)
+unsigned char SCCMapLutRuns(unsigned char node, const unsigned char *lut, const unsigned char *count, int n)
 {
-  lut_state_t *lut = lutState + (p - remote) / PAGE_SIZE;
+  int i, j, start, largest, total = 0, pos = 0;
+
+  for (i = 0; i < n; i++) total += count[i];
+
+  pthread_mutex_lock(&lutLock);
+  lutStats.map_misses++;
+  while ((start = LutAlloc(total, &largest)) < 0) {
+    if (!MapEvict()) {
+      lutStats.failed++;
+      pthread_mutex_unlock(&lutLock);
+      printf("Not enough available LUT entries! (%d requested, largest free run %d)\n", total, largest);
+      return 0;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < count[i]; j++) {
+      LUT(node_location, REMOTE_LUT + start + pos++) = LUT(node, lut[i] + j);
+    }
+  }
+  SCCSyncLut(REMOTE_LUT + start, total);
 
-  if (lut + lut->size < lutState + remote_pages && lut[lut->size].free) {
-    lut->size += lut[lut->size].size;
+  pthread_mutex_unlock(&lutLock);
+  TRACE(TRACE_LUT_MAP, node, REMOTE_LUT + start, total);
+  return REMOTE_LUT + start;
+}
+
+void SCCFreeLut(void *p)
+{
+  int start = (p - remote) / PAGE_SIZE;
+  lut_map_t *map;
+
+  TRACE(TRACE_LUT_UNMAP, 0, REMOTE_LUT + start, 0);
+  pthread_mutex_lock(&lutLock);
+  if (lutRun[start] == 0) {
+    pthread_mutex_unlock(&lutLock);
+    printf("Invalid LUT run\n");
+    return;
   }
 
-  if (lutState < lut && lut[-1].free) {
-    lut -= lut[-1].size;
-    lut->size += lut[lut->size].size;
+  if (lutRefs[start]) lutRefs[start]--;
+
+  /* Cached runs stay mapped for the next transfer from the same origin. */
+  for (map = mapCache; map < mapCache + MAP_CACHE_SIZE; map++) {
+    if (map->count && map->local == start) {
+      pthread_mutex_unlock(&lutLock);
+      return;
+    }
   }
 
-  lut->free = 1;
-  lut[lut->size - 1] = lut[0];
+  if (!lutRefs[start]) LutRelease(start);
+  pthread_mutex_unlock(&lutLock);
+}
+
+void SCCLutStats(lut_stats_t *stats)
+{
+  int largest;
+
+  pthread_mutex_lock(&lutLock);
+  *stats = lutStats;
+  if (remap) LutFindRun(0, &largest);
+  else largest = 0;
+  stats->largest_free = largest;
+  stats->free_entries = remap ? remote_pages - lutStats.used_entries : 0;
+  pthread_mutex_unlock(&lutLock);
 }
 
 void SCCFree(void *p)
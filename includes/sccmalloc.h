@@ -8,6 +8,10 @@
 #define LOCAL_LUT   0x14
 #define REMOTE_LUT  (LOCAL_LUT + local_pages)
 
+/* Without remapping the remote window has COPY_SLOTS entries, through which
+ * SNetDistribPack copies one destination page per slot. */
+#define COPY_SLOTS  4
+
 
 extern void *remote;
 extern unsigned char local_pages;
@@ -17,13 +21,50 @@ typedef struct {
   uint32_t offset;
 } lut_addr_t;
 
+/* Counters of the remote LUT window, see SCCLutStats. */
+typedef struct {
+  unsigned int live_runs, used_entries, free_entries, largest_free;
+  unsigned int allocs, frees, failed;
+  unsigned int map_hits, map_misses;
+} lut_stats_t;
+
+/* One step of the startup remap: own LUT entry lut takes over entry src of
+ * node, see SCCRemapPlan. */
+typedef struct {
+  unsigned char lut, node, src;
+} lut_remap_t;
+
 lut_addr_t SCCPtr2Addr(void *p);
 void *SCCAddr2Ptr(lut_addr_t addr);
 
+/* Compute which pages of the inactive cores node borrows when active cores
+ * run out of cores total, each core owning pages_per_core pages of which
+ * priv_pages stay private, until node has max_pages pages. Fills plan (room
+ * for max_pages entries) and returns its length. Pure, so any layout can be
+ * checked off-chip. */
+int SCCRemapPlan(int node, int cores, int active, int pages_per_core, int priv_pages, int max_pages,
+                 lut_remap_t *plan);
+
+/* Write the plan into the own LUT with a single flush at the end. */
+void SCCApplyRemap(const lut_remap_t *plan, int count);
+
 void SCCInit(unsigned char size);
 void SCCStop(void);
 
+/* Must be called after rewriting LUT entries of the remote window. */
+void SCCSyncLut(unsigned char lut, unsigned char count);
+
 void *SCCMallocPtr(size_t size);
 unsigned char SCCMallocLut(size_t size);
+void SCCLutStats(lut_stats_t *stats);
+
+/* Map count remote LUT entries of node, starting at lut, into the remote
+ * window (reusing a cached mapping when possible). Release with SCCFree. */
+unsigned char SCCMapLut(unsigned char node, unsigned char lut, unsigned char count);
+
+/* Map n runs of node's LUT (count[i] entries from lut[i]) back to back into
+ * one run of the remote window and return its first entry. The run is not
+ * cached; release it with SCCFree on its first page. */
+unsigned char SCCMapLutRuns(unsigned char node, const unsigned char *lut, const unsigned char *count, int n);
 void SCCFree(void *p);
 #endif
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "sccsend.h"
+#include "scc.h"
+
+/* Producers push onto incoming, a stack, with a compare-and-swap; the
+ * progress thread takes the whole stack at once and appends it, reversed,
+ * to its own list of pending sends. */
+static mpb_send_t *volatile incoming;
+static volatile int outstanding;
+
+/* The progress thread sleeps on work while it has nothing to send; idle
+ * tells producers to wake it. */
+static pthread_once_t progressOnce = PTHREAD_ONCE_INIT;
+static sem_t work;
+static volatile int idle;
+
+/* Small frames to each node collect in a batch of the progress thread, see
+ * MPB_SEND_BATCH. forced asks it to send all batches now. */
+typedef struct {
+  int len;
+  uint64_t deadline;
+  char data[MPB_BATCH_MAX];
+} tx_batch_t;
+
+static tx_batch_t batches[CORES];
+static int batchBytes, batchUs;
+static volatile int batched, forced;
+
+/* mpb_send_wait and mpb_send_flush sleep on doneCond; waiters tells the
+ * progress thread to wake them when a send completes or a batch leaves. */
+static pthread_mutex_t doneLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+static volatile int waiters;
+
+static uint64_t NowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void Wake(void)
+{
+  if (idle && __sync_bool_compare_and_swap(&idle, 1, 0)) sem_post(&work);
+}
+
+/* A waiter counts itself before it checks its condition, so either it sees
+ * the change or we see it and take the lock it waits under. */
+static void WakeWaiters(void)
+{
+  __sync_synchronize();
+  if (waiters) {
+    pthread_mutex_lock(&doneLock);
+    pthread_cond_broadcast(&doneCond);
+    pthread_mutex_unlock(&doneLock);
+  }
+}
+
+/* Sleep until there is work or, with until, that time has come. */
+static void Sleep(uint64_t until)
+{
+  struct timespec ts;
+  uint64_t ns, now;
+
+  scc_stats_flush();
+  idle = 1;
+  __sync_synchronize();
+  if ((incoming || forced) && __sync_bool_compare_and_swap(&idle, 1, 0)) return;
+
+  if (until) {
+    /* The deadline may have passed while the thread got here. */
+    now = NowNs();
+    if (until > now) {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ns = ts.tv_nsec + (until - now);
+      ts.tv_sec += ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+      if (sem_timedwait(&work, &ts) == 0) return;
+    }
+    /* Timed out: take idle back, unless a producer did and posts. */
+    if (__sync_bool_compare_and_swap(&idle, 1, 0)) return;
+  }
+
+  while (sem_wait(&work));
+}
+
+static void Complete(mpb_send_t *req)
+{
+  mpb_send_cb_t cb = req->done_cb;
+  void *arg = req->arg;
+
+  /* The request may be reused as soon as it is done. */
+  __sync_synchronize();
+  req->done = true;
+  if (cb) cb(arg);
+  __sync_fetch_and_sub(&outstanding, 1);
+  WakeWaiters();
+}
+
+/* The batch goes out under the lock of its node, so it cannot land inside a
+ * message another thread holds the node for. */
+static bool FlushBatch(int node)
+{
+  tx_batch_t *batch = &batches[node];
+  struct iovec iov = { batch->data, batch->len };
+  bool sent;
+
+  if (batch->len == 0) return true;
+  if (!mpb_trylock_dest(node)) return false;
+  sent = mpb_try_sendv(node, MPB_MSG_BATCH, &iov, 1) == 0;
+  mpb_unlock_dest(node);
+  if (!sent) return false;
+
+  batch->len = 0;
+  batched--;
+  WakeWaiters();
+  return true;
+}
+
+/* Send req or add it to the batch of its node; false if the node has no
+ * room for it yet. */
+static bool Post(mpb_send_t *req)
+{
+  tx_batch_t *batch = &batches[req->node];
+  mpb_sub_t sub;
+  int i, size = 0;
+  bool sent;
+
+  for (i = 0; i < req->n; i++) size += req->iov[i].iov_len;
+
+  /* The batch and the frame after it go out in one hold. */
+  if (size > UINT8_MAX || size + (int) sizeof(mpb_sub_t) > batchBytes) {
+    if (!mpb_trylock_dest(req->node)) return false;
+    sent = FlushBatch(req->node) && mpb_try_sendv(req->node, req->type, req->iov, req->n) == 0;
+    mpb_unlock_dest(req->node);
+    return sent;
+  }
+
+  if (batch->len + (int) sizeof(mpb_sub_t) + size > batchBytes && !FlushBatch(req->node)) return false;
+
+  if (batch->len == 0) {
+    batch->deadline = NowNs() + batchUs * 1000ull;
+    batched++;
+  }
+
+  sub.len = size;
+  sub.type = req->type;
+  memcpy(batch->data + batch->len, &sub, sizeof(sub));
+  batch->len += sizeof(sub);
+  for (i = 0; i < req->n; i++) {
+    memcpy(batch->data + batch->len, req->iov[i].iov_base, req->iov[i].iov_len);
+    batch->len += req->iov[i].iov_len;
+  }
+
+  /* Full once not even an empty message fits; if the node has no room now,
+   * the deadline retries. */
+  if (batch->len + (int) sizeof(mpb_sub_t) > batchBytes) FlushBatch(req->node);
+  return true;
+}
+
+static void *ProgressThread(void *arg)
+{
+  mpb_send_t *head = NULL, **tail = &head, **link, *list, *req, *next;
+  bool blocked[CORES];
+  int node, sent;
+  uint64_t now, wake;
+
+  (void) arg;
+  while (true) {
+    list = __sync_lock_test_and_set(&incoming, NULL);
+    for (req = NULL; list; list = next) {
+      next = list->next;
+      list->next = req;
+      req = list;
+    }
+    for (*tail = req; *tail; tail = &(*tail)->next);
+
+    if (head == NULL && batched == 0) {
+      Sleep(0);
+      continue;
+    }
+
+    /* One pass over the pending sends; after a refusal the later frames to
+     * the same node wait for the next pass to keep their order. */
+    memset(blocked, 0, sizeof(blocked));
+    sent = 0;
+    for (link = &head; (req = *link) != NULL;) {
+      if (!blocked[req->node] && Post(req)) {
+        *link = req->next;
+        if (tail == &req->next) tail = link;
+        Complete(req);
+        sent++;
+      } else {
+        blocked[req->node] = true;
+        link = &req->next;
+      }
+    }
+
+    /* Batches past their deadline, all of them for mpb_send_flush. */
+    now = NowNs();
+    wake = UINT64_MAX;
+    for (node = 0; batched && node < CORES; node++) {
+      if (batches[node].len == 0) continue;
+      if ((forced || batches[node].deadline <= now) && !blocked[node] && FlushBatch(node)) sent++;
+      else if (batches[node].deadline < wake) wake = batches[node].deadline;
+    }
+
+    if (head == NULL && batched && wake > now && !forced) Sleep(wake);
+    else if (!sent) usleep(1);
+  }
+
+  return NULL;
+}
+
+static void StartProgressThread(void)
+{
+  char *bytes = getenv("SCC_BATCH_BYTES"), *us = getenv("SCC_BATCH_US");
+  pthread_t thread;
+
+  batchBytes = bytes ? atoi(bytes) : MPB_SEND_BATCH;
+  batchBytes = min(min(batchBytes, MPB_BATCH_MAX), MPB_MAX_PAYLOAD);
+  batchUs = us ? atoi(us) : MPB_SEND_BATCH_US;
+
+  sem_init(&work, 0, 0);
+  if (pthread_create(&thread, NULL, ProgressThread, NULL)) {
+    printf("Could not start progress thread\n");
+    exit(1);
+  }
+  pthread_detach(thread);
+}
+
+void mpb_isendv(mpb_send_t *req, int node, int type, const struct iovec *iov, int n, mpb_send_cb_t cb, void *arg)
+{
+  if (n > MPB_SEND_IOV) {
+    printf("Too many segments: %d\n", n);
+    exit(1);
+  }
+
+  pthread_once(&progressOnce, StartProgressThread);
+
+  req->node = node;
+  req->type = type;
+  req->n = n;
+  memcpy(req->iov, iov, n * sizeof(struct iovec));
+  req->done_cb = cb;
+  req->arg = arg;
+  req->done = false;
+  __sync_fetch_and_add(&outstanding, 1);
+
+  do {
+    req->next = incoming;
+  } while (!__sync_bool_compare_and_swap(&incoming, req->next, req));
+
+  Wake();
+}
+
+bool mpb_send_test(mpb_send_t *req)
+{
+  return req->done;
+}
+
+void mpb_send_wait(mpb_send_t *req)
+{
+  if (req->done) return;
+
+  pthread_mutex_lock(&doneLock);
+  __sync_fetch_and_add(&waiters, 1);
+  while (!req->done) pthread_cond_wait(&doneCond, &doneLock);
+  __sync_fetch_and_sub(&waiters, 1);
+  pthread_mutex_unlock(&doneLock);
+}
+
+void mpb_send_flush(void)
+{
+  scc_stats_flush();
+  __sync_fetch_and_add(&forced, 1);
+  Wake();
+
+  pthread_mutex_lock(&doneLock);
+  __sync_fetch_and_add(&waiters, 1);
+  while (outstanding || batched) pthread_cond_wait(&doneCond, &doneLock);
+  __sync_fetch_and_sub(&waiters, 1);
+  pthread_mutex_unlock(&doneLock);
+
+  __sync_fetch_and_sub(&forced, 1);
+}
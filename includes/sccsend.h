@@ -0,0 +1,51 @@
+#ifndef SCCSEND_H
+#define SCCSEND_H
+
+#include <sys/uio.h>
+
+#include "bool.h"
+
+/* Asynchronous MPB sends. mpb_isendv queues a frame on a lock-free local
+ * queue and returns at once; a progress thread, started with the first
+ * send, writes the queued frames into the remote MPBs with mpb_try_sendv.
+ * Frames to one destination keep their order, a destination without credits
+ * does not hold up the others. The request and the payload belong to the
+ * queue until the send is done: mpb_send_test or mpb_send_wait on the
+ * request, or the callback, which runs on the progress thread.
+ *
+ * mpb_sendv may still be used alongside the queue; it is serialized with the
+ * progress thread, but its frames are not ordered against queued ones to the
+ * same node unless mpb_send_flush comes first. */
+#define MPB_SEND_IOV        4
+
+/* Small frames are coalesced per destination into MPB_MSG_BATCH frames of
+ * up to SCC_BATCH_BYTES payload bytes (default MPB_SEND_BATCH, one MPB line;
+ * 0 turns coalescing off). A batch goes out when the next message does not
+ * fit, when a larger frame follows to the same node, SCC_BATCH_US
+ * microseconds (default MPB_SEND_BATCH_US) after its first message, or on
+ * mpb_send_flush. Such sends are done once copied into the batch. The
+ * receiver unpacks batches in the mpb_peek and mpb_drain functions. */
+#define MPB_SEND_BATCH      MPB_LINE_SIZE
+#define MPB_SEND_BATCH_US   20
+
+typedef void (*mpb_send_cb_t)(void *arg);
+
+typedef struct mpb_send {
+  int node, type, n;
+  struct iovec iov[MPB_SEND_IOV];
+  mpb_send_cb_t done_cb;
+  void *arg;
+  volatile bool done;
+  struct mpb_send *next;
+} mpb_send_t;
+
+/* Queue a frame of the n (at most MPB_SEND_IOV) segments in iov to node;
+ * cb (may be NULL) is called with arg once it is in the remote MPB. */
+void mpb_isendv(mpb_send_t *req, int node, int type, const struct iovec *iov, int n, mpb_send_cb_t cb, void *arg);
+bool mpb_send_test(mpb_send_t *req);
+void mpb_send_wait(mpb_send_t *req);
+
+/* Wait until all queued sends are done. */
+void mpb_send_flush(void);
+
+#endif /*SCCSEND_H*/
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "sccstats.h"
+#ifdef SCC_EMU
+#include "../sccemu.h"
+#endif
+
+typedef char stats_slot_fits[sizeof(scc_stats_t) <= STATS_SLOT ? 1 : -1];
+
+extern int NCMDeviceFD;
+
+static scc_stats_t privateStats;
+
+scc_stats_t *scc_stats = &privateStats;
+pthread_mutex_t scc_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+__thread scc_stats_cache_t *scc_stats_thread;
+static pthread_once_t cacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t cacheKey;
+
+/* The statistics live in shared DRAM, mapped uncached so every core sees the
+ * stores of the others without a flush. */
+static void *MapStats(int prot)
+{
+  void *base;
+
+#ifdef SCC_EMU
+  base = EmuSharedMem(STATS_SIZE);
+#else
+  base = mmap(NULL, STATS_SIZE, prot, MAP_SHARED, NCMDeviceFD, STATS_ADDR);
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    exit(-1);
+  }
+#endif
+
+  return base;
+}
+
+void scc_stats_init(int node)
+{
+  char *env = getenv("SCC_STATS");
+  scc_stats_t *slot;
+
+  if (env && !atoi(env)) return;
+
+  slot = STATS_SLOT_OF(MapStats(PROT_READ | PROT_WRITE), node);
+  memset(slot, 0, sizeof(scc_stats_t));
+  slot->pid = getpid();
+  __sync_synchronize();
+  slot->magic = STATS_MAGIC;
+
+  scc_stats = slot;
+}
+
+const void *scc_stats_map(void)
+{
+  return MapStats(PROT_READ);
+}
+
+/* Publish the counts of an exiting thread. */
+static void ReleaseCache(void *cache)
+{
+  scc_stats_publish(cache);
+  free(cache);
+}
+
+static void CreateCacheKey(void)
+{
+  pthread_key_create(&cacheKey, ReleaseCache);
+}
+
+scc_stats_cache_t *scc_stats_new_cache(void)
+{
+  pthread_once(&cacheOnce, CreateCacheKey);
+
+  if ((scc_stats_thread = calloc(1, sizeof(scc_stats_cache_t))) == NULL) {
+    printf("Out of memory for the statistics\n");
+    exit(1);
+  }
+  pthread_setspecific(cacheKey, scc_stats_thread);
+  return scc_stats_thread;
+}
+
+void scc_stats_publish(scc_stats_cache_t *cache)
+{
+  int peer;
+
+  for (peer = 0; peer < STATS_CORES; peer++) {
+    if (cache->tx_msgs[peer]) {
+      __sync_fetch_and_add(&scc_stats->tx_msgs[peer], cache->tx_msgs[peer]);
+      __sync_fetch_and_add(&scc_stats->tx_bytes[peer], cache->tx_bytes[peer]);
+      cache->tx_msgs[peer] = cache->tx_bytes[peer] = 0;
+    }
+    if (cache->rx_msgs[peer]) {
+      __sync_fetch_and_add(&scc_stats->rx_msgs[peer], cache->rx_msgs[peer]);
+      __sync_fetch_and_add(&scc_stats->rx_bytes[peer], cache->rx_bytes[peer]);
+      cache->rx_msgs[peer] = cache->rx_bytes[peer] = 0;
+    }
+  }
+  cache->pending = 0;
+}
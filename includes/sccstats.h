@@ -0,0 +1,140 @@
+#ifndef SCCSTATS_H
+#define SCCSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "../config.h"
+
+/* Every core keeps its transport counters in its own STATS_SLOT bytes of
+ * shared DRAM at STATS_ADDR, where sccstat (or anything else that maps the
+ * same page) can read them while the job runs; a reader may see a value that
+ * is a few updates old. The slot is uncached on the chip, so only events that
+ * cost far more than a store are counted there directly. Several threads of
+ * the core write it: the per-peer frame counters are collected per thread
+ * and added atomically (see scc_stats_tx), the LUT counters are written under
+ * the LUT lock, heap_bytes atomically, and all other events go through
+ * scc_stats_event. */
+#define STATS_ADDR          SHM_X0_Y0
+#define STATS_SLOT          2048
+#define STATS_CORES         (NUM_ROWS * NUM_COLS * NUM_CORES)
+#define STATS_SIZE          (STATS_CORES * STATS_SLOT)
+#define STATS_MAGIC         0x53434353
+
+/* SNetDistribPack transports, see scc_stats_t.packs. */
+#define STATS_PACK_INLINE   0
+#define STATS_PACK_STREAM   1
+#define STATS_PACK_REMAP    2
+#define STATS_PACK_COPY     3
+#define STATS_PACK_RECORD   4
+#define STATS_PACK_BCAST    5
+#define STATS_PACKS         6
+
+typedef struct {
+  uint32_t magic;                   /* STATS_MAGIC once the node is up */
+  uint32_t pid;
+
+  /* MPB frames and payload bytes per peer. */
+  uint64_t tx_msgs[STATS_CORES], tx_bytes[STATS_CORES];
+  uint64_t rx_msgs[STATS_CORES], rx_bytes[STATS_CORES];
+
+  /* Sends that found the ring full, and the time they waited for room. */
+  uint64_t stalls, stall_ns;
+
+  /* Rewrites of the remote LUT window, and the entries rewritten. */
+  uint64_t lut_remaps, lut_remap_pages;
+
+  /* SNetDistribPack calls and payload bytes per transport. */
+  uint64_t packs[STATS_PACKS], pack_bytes[STATS_PACKS];
+
+  /* SCCMallocPtr bytes and remote LUT entries in use, with high-water marks. */
+  size_t heap_bytes, heap_peak;
+  size_t lut_entries, lut_peak;
+} scc_stats_t;
+
+#define STATS_SLOT_OF(base, core)  ((scc_stats_t*) ((char*) (base) + (core) * STATS_SLOT))
+
+/* The own slot. Points at private memory until scc_stats_init has run, so
+ * counting is always safe. */
+extern scc_stats_t *scc_stats;
+
+/* Map the statistics area and claim (and clear) the slot of node. With
+ * SCC_STATS=0 the counters stay in private memory. Called by scc_init after
+ * InitAPI. */
+void scc_stats_init(int node);
+
+/* Map the statistics area of all cores read-only, for readers. */
+const void *scc_stats_map(void);
+
+extern pthread_mutex_t scc_stats_lock;
+
+/* Count one event into count and n into total (may be NULL). */
+static inline void scc_stats_event(uint64_t *count, uint64_t *total, uint64_t n)
+{
+  pthread_mutex_lock(&scc_stats_lock);
+  (*count)++;
+  if (total) *total += n;
+  pthread_mutex_unlock(&scc_stats_lock);
+}
+
+/* Frames and payload bytes per peer are counted by each thread in private
+ * memory and added to the slot every STATS_PUBLISH frames, when the thread
+ * waits for frames or exits, and on scc_stats_flush. */
+#define STATS_PUBLISH       64
+
+typedef struct {
+  int pending;
+  uint64_t tx_msgs[STATS_CORES], tx_bytes[STATS_CORES];
+  uint64_t rx_msgs[STATS_CORES], rx_bytes[STATS_CORES];
+} scc_stats_cache_t;
+
+extern __thread scc_stats_cache_t *scc_stats_thread;
+
+scc_stats_cache_t *scc_stats_new_cache(void);
+void scc_stats_publish(scc_stats_cache_t *cache);
+
+/* Add the counts of the calling thread to the slot. */
+static inline void scc_stats_flush(void)
+{
+  if (scc_stats_thread && scc_stats_thread->pending) scc_stats_publish(scc_stats_thread);
+}
+
+static inline void scc_stats_tx(int peer, size_t bytes)
+{
+  scc_stats_cache_t *cache = scc_stats_thread ? scc_stats_thread : scc_stats_new_cache();
+
+  cache->tx_msgs[peer]++;
+  cache->tx_bytes[peer] += bytes;
+  if (++cache->pending == STATS_PUBLISH) scc_stats_publish(cache);
+}
+
+static inline void scc_stats_rx(int peer, size_t bytes)
+{
+  scc_stats_cache_t *cache = scc_stats_thread ? scc_stats_thread : scc_stats_new_cache();
+
+  cache->rx_msgs[peer]++;
+  cache->rx_bytes[peer] += bytes;
+  if (++cache->pending == STATS_PUBLISH) scc_stats_publish(cache);
+}
+
+static inline void scc_stats_heap(long delta)
+{
+  size_t peak, bytes = __sync_add_and_fetch(&scc_stats->heap_bytes, delta);
+
+  while (bytes > (peak = scc_stats->heap_peak) &&
+         !__sync_bool_compare_and_swap(&scc_stats->heap_peak, peak, bytes));
+}
+
+static inline void scc_stats_lut(size_t entries)
+{
+  scc_stats->lut_entries = entries;
+  if (entries > scc_stats->lut_peak) scc_stats->lut_peak = entries;
+}
+
+static inline void scc_stats_pack(int transport, size_t size)
+{
+  scc_stats_event(&scc_stats->packs[transport], &scc_stats->pack_bytes[transport], size);
+}
+
+#endif /*SCCSTATS_H*/
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scctrace.h"
+
+#ifdef SCC_TRACE
+
+trace_event_t trace_ring[TRACE_EVENTS];
+volatile uint32_t trace_count;
+
+static trace_header_t header;
+
+static void WriteTrace(void)
+{
+  char name[256], *dir = getenv("SCC_TRACE_DIR");
+  uint32_t count = trace_count, n = count < TRACE_EVENTS ? count : TRACE_EVENTS;
+  uint32_t start = (count - n) % TRACE_EVENTS, tail = TRACE_EVENTS - start < n ? TRACE_EVENTS - start : n;
+  FILE *file;
+
+  snprintf(name, sizeof(name), "%s/scc_trace.%d", dir ? dir : ".", header.node);
+  if ((file = fopen(name, "w")) == NULL) {
+    perror("fopen");
+    return;
+  }
+
+  /* Once the ring has wrapped, the oldest event is the one at start. */
+  header.count = count;
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(trace_ring + start, sizeof(trace_event_t), tail, file);
+  fwrite(trace_ring, sizeof(trace_event_t), n - tail, file);
+  fclose(file);
+}
+
+void scc_trace_init(int node)
+{
+  struct timespec mono, real;
+
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  clock_gettime(CLOCK_REALTIME, &real);
+
+  header.magic = TRACE_MAGIC;
+  header.version = TRACE_VERSION;
+  header.node = node;
+  header.mono_ns = mono.tv_sec * 1000000000ull + mono.tv_nsec;
+  header.real_ns = real.tv_sec * 1000000000ull + real.tv_nsec;
+
+  trace_count = 0;
+  atexit(WriteTrace);
+}
+
+#endif
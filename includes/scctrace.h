@@ -0,0 +1,76 @@
+#ifndef SCCTRACE_H
+#define SCCTRACE_H
+
+#include <stdint.h>
+
+/* Event trace of the MPB and LUT traffic, compiled in with -DSCC_TRACE
+ * (make TRACE=1). Every node records timestamped events into a private ring
+ * of TRACE_EVENTS entries, the oldest being overwritten, and writes the ring
+ * to SCC_TRACE_DIR/scc_trace.<node> (default: the working directory) when it
+ * exits. tracemerge aligns the clocks of the nodes and turns the files into
+ * one Chrome trace. Without SCC_TRACE the TRACE macros compile to nothing. */
+#define TRACE_EVENTS        (64 * 1024)
+#define TRACE_MAGIC         0x53435454
+#define TRACE_VERSION       2
+
+/* Event types; peer, a and b are given per type. */
+#define TRACE_SEND_BEGIN    1   /* destination, sequence number, payload bytes */
+#define TRACE_SEND_END      2   /* destination, sequence number, payload bytes */
+#define TRACE_STALL         3   /* destination, waited us, payload bytes */
+#define TRACE_RECV          4   /* sender, sequence number, payload bytes */
+#define TRACE_WAIT_BEGIN    5   /* -, -, - */
+#define TRACE_WAIT_END      6   /* -, -, - */
+#define TRACE_LUT_MAP       7   /* origin node, own LUT entry, entries */
+#define TRACE_LUT_HIT       8   /* origin node, own LUT entry, entries */
+#define TRACE_LUT_UNMAP     9   /* -, own LUT entry, - */
+#define TRACE_ALLOC         10  /* -, bytes, - */
+#define TRACE_FREE          11  /* -, -, - */
+
+typedef struct {
+  uint64_t ts;                      /* CLOCK_MONOTONIC, ns */
+  uint32_t a, b;
+  uint16_t type, peer;
+  uint32_t pad;
+} trace_event_t;
+
+/* A trace file is this header followed by min(count, TRACE_EVENTS) events,
+ * oldest first. The clocks sampled at scc_trace_init give the merger a
+ * first guess of the offset between the monotonic clocks of two nodes. */
+typedef struct {
+  uint32_t magic;
+  uint16_t version, node;
+  uint64_t count;
+  uint64_t mono_ns, real_ns;
+} trace_header_t;
+
+#ifdef SCC_TRACE
+#include <time.h>
+
+extern trace_event_t trace_ring[TRACE_EVENTS];
+extern volatile uint32_t trace_count;
+
+static inline void scc_trace(int type, int peer, uint32_t a, uint32_t b)
+{
+  struct timespec ts;
+  trace_event_t *e = &trace_ring[__sync_fetch_and_add(&trace_count, 1) % TRACE_EVENTS];
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  e->ts = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  e->a = a;
+  e->b = b;
+  e->type = type;
+  e->peer = peer;
+}
+
+/* Start recording for node and write the ring out at exit. Called by
+ * scc_init. */
+void scc_trace_init(int node);
+
+#define TRACE(type, peer, a, b)   scc_trace(type, peer, a, b)
+#define TRACE_INIT(node)          scc_trace_init(node)
+#else
+#define TRACE(type, peer, a, b)   ((void) 0)
+#define TRACE_INIT(node)          ((void) 0)
+#endif
+
+#endif /*SCCTRACE_H*/
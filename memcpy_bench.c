@@ -0,0 +1,99 @@
+/*
+ * Compares the memcpy_get/memcpy_put kernels of RCCE_memcpy.c per copy size.
+ *
+ * Runs on a single core or host, no MPB or LUT setup is needed. For every
+ * kernel the CPU supports, one CSV line per direction and size is written:
+ *
+ *   variant,direction,size,iterations,ns,mbps
+ *
+ * ns is the mean time of one copy. The buffers are misaligned by -a bytes to
+ * exercise the unaligned heads and tails of the kernels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "RCCE_memcpy.c"
+
+#define MIN_COPY    32
+#define MAX_COPY    (1024 * 1024)
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Enough iterations for roughly 64MB per measurement, but at least 16. */
+static int count_for(size_t size, int iterations)
+{
+  size_t n = (64 * 1024 * 1024) / size;
+
+  if (iterations) return iterations;
+  return n < 16 ? 16 : n;
+}
+
+static void run(const memcpy_variant_t *variant, const char *dir, memcpy_func_t copy,
+                char *dst, char *src, size_t size, int iterations)
+{
+  int i, n = count_for(size, iterations);
+  double start, elapsed;
+
+  memset(dst, 0, size);
+  copy(dst, src, size);
+  if (memcmp(dst, src, size)) {
+    fprintf(stderr, "%s %s: copy of %lu bytes is wrong\n", variant->name, dir, (unsigned long) size);
+    exit(1);
+  }
+
+  start = now_ns();
+  for (i = 0; i < n; i++) copy(dst, src, size);
+  elapsed = now_ns() - start;
+
+  printf("%s,%s,%lu,%d,%.1f,%.1f\n", variant->name, dir, (unsigned long) size, n, elapsed / n,
+         (double) size * n / elapsed * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+  int opt, align = 0, iterations = 0;
+  size_t i, size;
+  char *src, *dst;
+
+  while ((opt = getopt(argc, argv, "a:i:")) != -1) {
+    switch (opt) {
+      case 'a': align = atoi(optarg) & 63; break;
+      case 'i': iterations = atoi(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-a misalignment] [-i iterations]\n", argv[0]);
+        exit(1);
+    }
+  }
+
+  src = aligned_alloc(64, MAX_COPY + 64);
+  dst = aligned_alloc(64, MAX_COPY + 64);
+  if (src == NULL || dst == NULL) {
+    perror("aligned_alloc");
+    exit(1);
+  }
+  for (i = 0; i < MAX_COPY + 64; i++) src[i] = i * 7;
+
+  printf("variant,direction,size,iterations,ns,mbps\n");
+  for (i = 0; i < MEMCPY_VARIANTS; i++) {
+    if (!memcpy_supported(&memcpy_variants[i])) continue;
+
+    for (size = MIN_COPY; size <= MAX_COPY; size *= 2) {
+      run(&memcpy_variants[i], "get", memcpy_variants[i].get, dst + align, src + align, size, iterations);
+      run(&memcpy_variants[i], "put", memcpy_variants[i].put, dst + align, src + align, size, iterations);
+    }
+  }
+
+  free(src);
+  free(dst);
+  return 0;
+}
@@ -2,13 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "scc_comm_func.h"
 
 // includes for the LUT mapping
 #include "bool.h"
 #include "config.h"
-#include "RCCE_memcpy.c"
+#include "RCCE_memcpy.h"
 #include "distribution.h"
 #include "scc.h"
 #include "sccmalloc.h"
@@ -30,6 +31,20 @@ bool remap =false;
 int node_location;
 static int num_nodes = 0;
 
+scc_timing_t scc_timing;
+
+/* Microseconds since *t, which is then reset to now. */
+static double elapsed_us(struct timespec *t)
+{
+  struct timespec now;
+  double us;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  us = (now.tv_sec - t->tv_sec) * 1e6 + (now.tv_nsec - t->tv_nsec) / 1e3;
+  *t = now;
+  return us;
+}
+
 void scc_init(){
 
 //variables for the MPB init
@@ -40,11 +55,13 @@ void scc_init(){
 //variables for the LUT init
    sigset_t signal_mask;
    unsigned char num_pages;
+   struct timespec t;
 
 //INIT START!!!
 
    remap=true;
-   num_nodes = DLPEL_ACTIVE_NODES;
+   scc_topology_init();
+   num_nodes = topology.active_nodes;
 
    sigemptyset(&signal_mask);
    sigaddset(&signal_mask, SIGUSR1);
@@ -54,7 +71,9 @@ void scc_init(){
 
 //**********************************
 
+   clock_gettime(CLOCK_MONOTONIC, &t);
    InitAPI(0);
+   scc_timing.api = elapsed_us(&t);
 
 //**********************************
 
@@ -64,8 +83,10 @@ void scc_init(){
    y = (z >> 7) & 0x0f; // bits 10:07
    z = z & 7; // bits 02:00
    node_location = PID(x, y, z);
+   scc_stats_init(node_location);
+   TRACE_INIT(node_location);
 
-  for (cpu = 0; cpu < 48; cpu++) {
+  for (cpu = 0; cpu < topology.cores; cpu++) {
     x = X_PID(cpu);
     y = Y_PID(cpu);
     z = Z_PID(cpu);
@@ -82,58 +103,45 @@ void scc_init(){
     MPBalloc(&mpbs[cpu], x, y, z, cpu == node_location);
   }
 
+  scc_timing.map = elapsed_us(&t);
+
 //***********************************************
 //LUT remapping
 
-  num_pages = PAGES_PER_CORE - LINUX_PRIV_PAGES;
-    int max_pages = remap ? MAX_PAGES/2 : MAX_PAGES - 1;
-
-    printf("First for loops\n");
+  lut_remap_t plan[MAX_PAGES];
+  int max_pages = remap ? topology.max_pages/2 : topology.max_pages - COPY_SLOTS;
+  int count;
 
-   int i, lut;
+  count = SCCRemapPlan(node_location, topology.cores, num_nodes, topology.pages_per_core, LINUX_PRIV_PAGES,
+                       max_pages, plan);
+  SCCApplyRemap(plan, count);
+  num_pages = topology.pages_per_core - LINUX_PRIV_PAGES + count;
 
-   for (i = 1; i < CORES / num_nodes && num_pages < max_pages; i++) {
-      for (lut = 0; lut < PAGES_PER_CORE && num_pages < max_pages; lut++) {
-        printf("Copy to %i  node's LUT entry Nr.: %i / %x from (node_location+i*num_nodes)= %i node's LUT entry Nr.: %i / %x.  Condition: num_pages: %i < max_pages: %i\n",
-                  node_location, LINUX_PRIV_PAGES + num_pages,LINUX_PRIV_PAGES+num_pages, node_location + i * num_nodes,  lut, lut, num_pages, max_pages);
-  	LUT(node_location, LINUX_PRIV_PAGES + num_pages++) = LUT(node_location + i * num_nodes, lut);
-    }
-    }
-
-    int extra = ((CORES % num_nodes) * PAGES_PER_CORE) / num_nodes;
-    int node = num_nodes + (node_location * extra) / PAGES_PER_CORE;
-    int lut2 = (node_location * extra) % PAGES_PER_CORE;
-
-    printf("Second for loop\n");
-    i=0;
-    for (i = 0; i < extra && num_pages < max_pages; i++ ) {
-  	printf("Copy to %i  node's LUT entry Nr.: %i from (node_location+i*num_nodes)= %i node's LUT entry Nr.: %i\n",
-                  node_location, LINUX_PRIV_PAGES + num_pages, node_location + i * num_nodes,  lut2);
-      LUT(node_location, LINUX_PRIV_PAGES + num_pages++) = LUT(node, lut2 + i);
-
-      if (lut + i + 1 == PAGES_PER_CORE) {
-        lut2 = 0;
-        node++;
-      }
-    }
+  scc_timing.remap = elapsed_us(&t);
 
 //***********************************************
 
 //LUT settings
-    flush();
-    START(node_location) = 0;
-    END(node_location) = 0;
-    /* Start with an initial handling run to avoid a cross-core race. */
-    HANDLING(node_location) = 1;
-    WRITING(node_location) = false;
+    mpb_init(node_location);
 
 //***********************************************
 
     SCCInit(num_pages);
+    SNetDistribCalibrate();
+
+  scc_timing.alloc = elapsed_us(&t);
+  scc_timing.pages = num_pages;
 
 //***********************************************
 
   FOOL_WRITE_COMBINE;
   unlock(node_location);
+  mpb_start();
+
+  scc_timing.total = scc_timing.api + scc_timing.map + scc_timing.remap + scc_timing.alloc;
+  if (DEBUG) {
+    printf("scc_init: %d pages, api %.0f us, map %.0f us, remap %.0f us, alloc %.0f us\n", scc_timing.pages,
+           scc_timing.api, scc_timing.map, scc_timing.remap, scc_timing.alloc);
+  }
 
 }
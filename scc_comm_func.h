@@ -0,0 +1,17 @@
+#ifndef SCC_COMM_FUNC_H
+#define SCC_COMM_FUNC_H
+
+/* Map the CRBs, MPBs and LUTs of all cores, remap the borrowed pages of the
+ * inactive cores into the own LUT and initialise the allocator. */
+void scc_init();
+
+/* Wall-clock time of the scc_init phases in microseconds, and the number of
+ * pages the node ended up with. */
+typedef struct {
+  double api, map, remap, alloc, total;
+  int pages;
+} scc_timing_t;
+
+extern scc_timing_t scc_timing;
+
+#endif /*SCC_COMM_FUNC_H*/
@@ -0,0 +1,216 @@
+/*
+ * Software emulation of the SCC memory system on stock Linux, see sccemu.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <time.h>
+
+#include "config.h"
+#include "includes/scc.h"
+#include "sccemu.h"
+
+#define EMU_DRAM_PAGES      (CORES * PAGES_PER_CORE + EMU_SHARED_PAGES)
+
+typedef struct {
+  unsigned char crb[EMU_TILES][EMU_CRB_SIZE];
+  unsigned char mpb[CORES][MPBSIZE];
+  unsigned char fpga[MPBSIZE];
+} emu_shm_t;
+
+int emu_node;
+
+static emu_shm_t *shm;
+static int dram = -1;
+static int tileid;
+
+static const char *EmuName(void)
+{
+  const char *name = getenv("SCC_EMU_NAME");
+  return name ? name : "/scc_emu";
+}
+
+static int EmuOpen(const char *suffix, off_t size)
+{
+  char name[256];
+  int fd;
+
+  snprintf(name, sizeof(name), "%s%s", EmuName(), suffix);
+  if ((fd = shm_open(name, O_RDWR | O_CREAT, 0600)) < 0) {
+    perror("shm_open");
+    exit(-1);
+  }
+
+  /* Growing an object to its own size is a no-op, so every core may do it. */
+  if (ftruncate(fd, size) < 0) {
+    perror("ftruncate");
+    exit(-1);
+  }
+
+  return fd;
+}
+
+void EmuInit(int printMessages)
+{
+  int fd, core, lut;
+  char *env = getenv("SCC_EMU_NODE");
+
+  if (env) emu_node = atoi(env);
+  if (emu_node < 0 || emu_node >= CORES) {
+    printf("EmuInit: Invalid core ID %d\n", emu_node);
+    exit(-1);
+  }
+
+  fd = EmuOpen("", sizeof(emu_shm_t));
+  shm = mmap(NULL, sizeof(emu_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (shm == MAP_FAILED) {
+    perror("mmap");
+    exit(-1);
+  }
+  close(fd);
+
+  dram = EmuOpen("_dram", (off_t) EMU_DRAM_PAGES * PAGE_SIZE);
+
+  /* Boot-time LUT contents. The private entries are never rewritten after
+   * boot, so every core fills them in for all cores and does not have to wait
+   * for its peers before borrowing their pages. */
+  for (core = 0; core < CORES; core++) {
+    volatile uint64_t *table = (uint64_t*) EmuConfigReg(CRB_ADDR(X_PID(core), Y_PID(core))
+                                                        + (Z_PID(core) ? LUT1 : LUT0));
+
+    for (lut = 0; lut < PAGES_PER_CORE; lut++) {
+      table[lut] = core * PAGES_PER_CORE + lut;
+    }
+
+    if (core == emu_node) {
+      for (lut = 0; lut < EMU_SHARED_PAGES; lut++) {
+        table[EMU_SHARED_LUT + lut] = CORES * PAGES_PER_CORE + lut;
+      }
+    }
+  }
+
+  tileid = (Y_PID(emu_node) << 7) | (X_PID(emu_node) << 3) | Z_PID(emu_node);
+
+  if (printMessages) printf("Emulating SCC core %d in %s\n", emu_node, EmuName());
+}
+
+void EmuDestroy(void)
+{
+  char name[256];
+
+  snprintf(name, sizeof(name), "%s", EmuName());
+  shm_unlink(name);
+  snprintf(name, sizeof(name), "%s_dram", EmuName());
+  shm_unlink(name);
+}
+
+int EmuFork(int nodes)
+{
+  int node;
+  char id[16];
+
+  for (node = 1; node < nodes; node++) {
+    if (fork() == 0) {
+      snprintf(id, sizeof(id), "%d", node);
+      setenv("SCC_EMU_NODE", id, 1);
+      return node;
+    }
+  }
+
+  setenv("SCC_EMU_NODE", "0", 1);
+  return 0;
+}
+
+int *EmuConfigReg(unsigned int ConfigAddr)
+{
+  unsigned int tile, offset = ConfigAddr & 0x00ffffff;
+
+  if (ConfigAddr >= FPGA_BASE) {
+    return (int*) (shm->fpga + (offset % MPBSIZE & ~3));
+  }
+
+  if (ConfigAddr >= CRB_OWN) {
+    if (offset == MYTILEID) return &tileid;
+    tile = emu_node / NUM_CORES;
+  } else {
+    tile = (ConfigAddr - CRB_X0_Y0) >> 24;
+  }
+
+  if (tile >= EMU_TILES || offset >= EMU_CRB_SIZE) {
+    printf("EmuConfigReg: Invalid address %08x\n", ConfigAddr);
+    exit(-1);
+  }
+
+  return (int*) (shm->crb[tile] + offset);
+}
+
+unsigned char *EmuMPB(int x, int y, int core)
+{
+  return shm->mpb[PID(x, y, core)];
+}
+
+void *EmuSharedMem(size_t size)
+{
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dram,
+                    (off_t) CORES * PAGES_PER_CORE * PAGE_SIZE);
+
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    exit(-1);
+  }
+
+  return base;
+}
+
+void *EmuMapPages(void *addr, const volatile uint64_t *lut, int count)
+{
+  int i;
+  char *base = addr;
+
+  if (count <= 0) return base;
+
+  if (base == NULL) {
+    base = mmap(NULL, (size_t) count * PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      perror("mmap");
+      exit(-1);
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    if (lut[i] >= EMU_DRAM_PAGES) {
+      printf("EmuMapPages: LUT entry %d points to invalid page %llu\n", i, (unsigned long long) lut[i]);
+      exit(-1);
+    }
+
+    if (mmap(base + (size_t) i * PAGE_SIZE, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             dram, (off_t) lut[i] * PAGE_SIZE) == MAP_FAILED) {
+      perror("mmap");
+      exit(-1);
+    }
+  }
+
+  return base;
+}
+
+void EmuDoorbellRing(volatile int *pin)
+{
+  __sync_fetch_and_add(pin, 1);
+  syscall(SYS_futex, pin, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+void EmuDoorbellWait(volatile int *pin, int seen, int timeout_us)
+{
+  struct timespec timeout = { timeout_us / 1000000, (timeout_us % 1000000) * 1000 };
+
+  syscall(SYS_futex, pin, FUTEX_WAIT, seen, &timeout, NULL, 0);
+}
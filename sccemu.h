@@ -0,0 +1,56 @@
+/*
+ * Software emulation of the SCC memory system on stock Linux.
+ *
+ * Built with -DSCC_EMU. CRB registers, MPBs and LUTs of all cores live in
+ * one POSIX shared-memory object, DRAM pages in a second (sparse) one. Every
+ * emulated core is a separate process; its core ID is taken from the
+ * SCC_EMU_NODE environment variable (or assigned by EmuFork). The object
+ * names default to "/scc_emu" and can be changed through SCC_EMU_NAME so
+ * several jobs can run side by side.
+ */
+
+#ifndef SCCEMU_H
+#define SCCEMU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EMU_TILES           (NUM_ROWS * NUM_COLS)
+#define EMU_CRB_SIZE        0x2000
+#define EMU_LUT_ENTRIES     256
+
+/* Physical DRAM pages: PAGES_PER_CORE private pages per core, followed by
+ * EMU_SHARED_PAGES shared pages that every LUT maps at SHM_X0_Y0. */
+#define EMU_SHARED_PAGES    4
+#define EMU_SHARED_LUT      (SHM_X0_Y0 >> 24)
+
+extern int emu_node;
+
+/* Open (or create) the shared objects and map them. Called by InitAPI. */
+void EmuInit(int printMessages);
+
+/* Remove the shared objects; call once after the last core has finished. */
+void EmuDestroy(void);
+
+/* Fork nodes-1 children and return the core ID of the calling process. */
+int EmuFork(int nodes);
+
+/* Emulated counterparts of the device mappings in config.c. */
+int *EmuConfigReg(unsigned int ConfigAddr);
+unsigned char *EmuMPB(int x, int y, int core);
+
+/* Map the first size bytes of the shared DRAM pages, i.e. what SHM_X0_Y0
+ * maps on the chip. */
+void *EmuSharedMem(size_t size);
+
+/* Map count DRAM pages at addr (NULL to pick an address) according to the
+ * given LUT entries. Re-mapping an existing range replaces it in place. */
+void *EmuMapPages(void *addr, const volatile uint64_t *lut, int count);
+
+/* Doorbells on the emulated GLCFG registers: Ring bumps the register and
+ * wakes all waiters, Wait sleeps (at most timeout_us) while it still holds
+ * the value seen. Implemented with process-shared futexes. */
+void EmuDoorbellRing(volatile int *pin);
+void EmuDoorbellWait(volatile int *pin, int seen, int timeout_us);
+
+#endif /*SCCEMU_H*/
@@ -0,0 +1,116 @@
+/*
+ * Live dump of the per-core transport counters, see includes/sccstats.h.
+ *
+ * Runs on any core while a job is up (under SCC_EMU with the job's
+ * SCC_EMU_NAME) and prints one line per node that has claimed its slot:
+ *
+ *   node pid tx_msgs tx_MB rx_msgs rx_MB tx_MBps rx_MBps stalls stall_ms remaps
+ *   remap_pages heap_KB heap_peak_KB lut lut_peak inline stream remap copy record bcast
+ *
+ * every -i seconds (once with -i 0), -c times (forever with -c 0). The rates
+ * are over the last interval. -p adds the matrix of MPB bytes sent from each
+ * node (rows) to each peer (columns).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "config.h"
+#include "includes/sccstats.h"
+
+#define MB  (1024.0 * 1024.0)
+
+static scc_stats_t prev[STATS_CORES];
+
+static uint64_t sum(const uint64_t *counters)
+{
+  int i;
+  uint64_t total = 0;
+
+  for (i = 0; i < STATS_CORES; i++) total += counters[i];
+  return total;
+}
+
+static void dump(const void *base, double interval, int peers)
+{
+  int core, peer;
+  scc_stats_t s;
+  double tx, rx;
+
+  printf("node,pid,tx_msgs,tx_MB,rx_msgs,rx_MB,tx_MBps,rx_MBps,stalls,stall_ms,remaps,remap_pages,"
+         "heap_KB,heap_peak_KB,lut,lut_peak,inline,stream,remap,copy,record,bcast\n");
+
+  for (core = 0; core < STATS_CORES; core++) {
+    memcpy(&s, STATS_SLOT_OF(base, core), sizeof(s));
+    if (s.magic != STATS_MAGIC) continue;
+
+    tx = sum(s.tx_bytes);
+    rx = sum(s.rx_bytes);
+    printf("%d,%u,%llu,%.3f,%llu,%.3f,%.3f,%.3f,%llu,%.3f,%llu,%llu,%lu,%lu,%lu,%lu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+           core, s.pid, (unsigned long long) sum(s.tx_msgs), tx / MB, (unsigned long long) sum(s.rx_msgs), rx / MB,
+           interval ? (tx - sum(prev[core].tx_bytes)) / MB / interval : 0,
+           interval ? (rx - sum(prev[core].rx_bytes)) / MB / interval : 0,
+           (unsigned long long) s.stalls, s.stall_ns / 1e6,
+           (unsigned long long) s.lut_remaps, (unsigned long long) s.lut_remap_pages,
+           (unsigned long) (s.heap_bytes / 1024), (unsigned long) (s.heap_peak / 1024),
+           (unsigned long) s.lut_entries, (unsigned long) s.lut_peak,
+           (unsigned long long) s.packs[STATS_PACK_INLINE], (unsigned long long) s.packs[STATS_PACK_STREAM],
+           (unsigned long long) s.packs[STATS_PACK_REMAP], (unsigned long long) s.packs[STATS_PACK_COPY],
+           (unsigned long long) s.packs[STATS_PACK_RECORD], (unsigned long long) s.packs[STATS_PACK_BCAST]);
+
+    prev[core] = s;
+  }
+
+  if (!peers) return;
+
+  printf("tx_bytes");
+  for (peer = 0; peer < STATS_CORES; peer++) {
+    if (prev[peer].magic == STATS_MAGIC) printf(",%d", peer);
+  }
+  printf("\n");
+
+  for (core = 0; core < STATS_CORES; core++) {
+    if (prev[core].magic != STATS_MAGIC) continue;
+
+    printf("%d", core);
+    for (peer = 0; peer < STATS_CORES; peer++) {
+      if (prev[peer].magic == STATS_MAGIC) printf(",%llu", (unsigned long long) prev[core].tx_bytes[peer]);
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int opt, i, count = 0, peers = 0;
+  double interval = 1;
+  const void *base;
+
+  while ((opt = getopt(argc, argv, "i:c:p")) != -1) {
+    switch (opt) {
+      case 'i': interval = atof(optarg); break;
+      case 'c': count = atoi(optarg); break;
+      case 'p': peers = 1; break;
+      default:
+        fprintf(stderr, "Usage: %s [-i seconds] [-c count] [-p]\n", argv[0]);
+        exit(1);
+    }
+  }
+
+  InitAPI(0);
+  base = scc_stats_map();
+
+  /* The first sample has no previous one to compute rates against. */
+  dump(base, 0, peers);
+  for (i = 1; interval > 0 && (count == 0 || i < count); i++) {
+    usleep(interval * 1e6);
+    printf("\n");
+    dump(base, interval, peers);
+    fflush(stdout);
+  }
+
+  return 0;
+}
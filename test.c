@@ -4,7 +4,7 @@
 #include <stdio.h>
 
 #include "config.h"
-#include "RCCE_memcpy.c"
+#include "RCCE_memcpy.h"
 
 // includes for the LUT mapping
 #include "includes/distribution.h"
@@ -63,6 +63,40 @@ void writeToMpb(int core, int size,char *str){
 }
 
 
+// print the remap plan of every active node and check that no page is
+// borrowed twice or taken from an active core
+int printPlan(){
+  lut_remap_t plan[MAX_PAGES];
+  unsigned char owner[CORES][PAGES_PER_CORE];
+  int node, i, count, errors = 0;
+  int max_pages = remap ? topology.max_pages/2 : topology.max_pages - COPY_SLOTS;
+
+  memset(owner, 0xff, sizeof(owner));
+  for (node = 0; node < topology.active_nodes; node++) {
+    count = SCCRemapPlan(node, topology.cores, topology.active_nodes, topology.pages_per_core, LINUX_PRIV_PAGES,
+                         max_pages, plan);
+    printf("node %d: %d pages borrowed, %d in total\n", node, count,
+           topology.pages_per_core - LINUX_PRIV_PAGES + count);
+
+    for (i = 0; i < count; i++) {
+      printf("  LUT %3d <- node %2d LUT %2d\n", plan[i].lut, plan[i].node, plan[i].src);
+      if (plan[i].node < topology.active_nodes || plan[i].node >= topology.cores
+          || plan[i].src >= topology.pages_per_core) {
+        printf("  invalid source!\n");
+        errors++;
+      } else if (owner[plan[i].node][plan[i].src] != 0xff) {
+        printf("  already borrowed by node %d!\n", owner[plan[i].node][plan[i].src]);
+        errors++;
+      } else {
+        owner[plan[i].node][plan[i].src] = node;
+      }
+    }
+  }
+
+  printf("%d errors\n", errors);
+  return errors != 0;
+}
+
 int main(int argc, char **argv){
 
 //variables for the MPB init
@@ -77,7 +111,10 @@ int main(int argc, char **argv){
 //INIT START!!!
 
    remap=true;
-   num_nodes = DLPEL_ACTIVE_NODES;
+   scc_topology_init();
+   num_nodes = topology.active_nodes;
+
+   if (argc == 2 && !strcmp("plan", argv[1])) return printPlan();
 
    sigemptyset(&signal_mask);
    sigaddset(&signal_mask, SIGUSR1);
@@ -97,8 +134,10 @@ int main(int argc, char **argv){
    y = (z >> 7) & 0x0f; // bits 10:07
    z = z & 7; // bits 02:00
    node_location = PID(x, y, z);
+   scc_stats_init(node_location);
+   TRACE_INIT(node_location);
  
-  for (cpu = 0; cpu < 48; cpu++) {
+  for (cpu = 0; cpu < topology.cores; cpu++) {
     x = X_PID(cpu);
     y = Y_PID(cpu);
     z = Z_PID(cpu);
@@ -118,47 +157,19 @@ int main(int argc, char **argv){
 //***********************************************
 //LUT remapping
 
-  num_pages = PAGES_PER_CORE - LINUX_PRIV_PAGES;
-    int max_pages = remap ? MAX_PAGES/2 : MAX_PAGES - 1;
-
-    printf("First for loops\n");
-    
-   int i, lut;
- 
-   for (i = 1; i < CORES / num_nodes && num_pages < max_pages; i++) {
-      for (lut = 0; lut < PAGES_PER_CORE && num_pages < max_pages; lut++) {
-        printf("Copy to %i  node's LUT entry Nr.: %i / %x from (node_location+i*num_nodes)= %i node's LUT entry Nr.: %i / %x.  Condition: num_pages: %i < max_pages: %i\n",
-                  node_location, LINUX_PRIV_PAGES + num_pages,LINUX_PRIV_PAGES+num_pages, node_location + i * num_nodes,  lut, lut, num_pages, max_pages);
-  	LUT(node_location, LINUX_PRIV_PAGES + num_pages++) = LUT(node_location + i * num_nodes, lut);
-    }
-    }
+  lut_remap_t plan[MAX_PAGES];
+  int max_pages = remap ? topology.max_pages/2 : topology.max_pages - COPY_SLOTS;
+  int count;
 
-    int extra = ((CORES % num_nodes) * PAGES_PER_CORE) / num_nodes;
-    int node = num_nodes + (node_location * extra) / PAGES_PER_CORE;
-    int lut2 = (node_location * extra) % PAGES_PER_CORE;
-
-    printf("Second for loop\n");
-    i=0;
-    for (i = 0; i < extra && num_pages < max_pages; i++ ) {
-  	printf("Copy to %i  node's LUT entry Nr.: %i from (node_location+i*num_nodes)= %i node's LUT entry Nr.: %i\n",
-                  node_location, LINUX_PRIV_PAGES + num_pages, node_location + i * num_nodes,  lut2);
-      LUT(node_location, LINUX_PRIV_PAGES + num_pages++) = LUT(node, lut2 + i);
-
-      if (lut + i + 1 == PAGES_PER_CORE) {
-        lut2 = 0;
-        node++;
-      }
-    }
+  count = SCCRemapPlan(node_location, topology.cores, num_nodes, topology.pages_per_core, LINUX_PRIV_PAGES,
+                       max_pages, plan);
+  SCCApplyRemap(plan, count);
+  num_pages = topology.pages_per_core - LINUX_PRIV_PAGES + count;
 
 //***********************************************
 
 //LUT settings
-    flush();
-    START(node_location) = 0;
-    END(node_location) = 0;
-    /* Start with an initial handling run to avoid a cross-core race. */
-    HANDLING(node_location) = 1;
-    WRITING(node_location) = false;
+    mpb_init(node_location);
 
 //***********************************************
 
@@ -207,14 +218,15 @@ int main(int argc, char **argv){
 	// send lut entry
 	size=sizeof(task_t);
 	//SNetDistribPack(test_task,buffer, sizeof(test_task), true);
-      cpy_mem_to_mpb(atoi(argv[2]), addr, sizeof(lut_addr_t));
-      cpy_mem_to_mpb(atoi(argv[2]), &size, sizeof(size_t)); 
+	struct iovec msg[2] = { { addr, sizeof(lut_addr_t) }, { &size, sizeof(size_t) } };
+      cpy_mem_to_mpbv(atoi(argv[2]), msg, 2);
    }else{
       fprintf(stderr, "Usage:\n"
           "%s test <destination core> \n"
           "read <source core ID> <data size> \n"
           "write <destination core ID> <data size> (<char to write> || <string to write>) \n"
-    	  "lutsend <destination core ID> (<char to write> || <string to write>) \n", argv[0]);
+    	  "lutsend <destination core ID> (<char to write> || <string to write>) \n"
+          "plan \n", argv[0]);
        exit(1);
     }
 
@@ -0,0 +1,322 @@
+/*
+ * Merges the scc_trace.<node> files written under SCC_TRACE (see
+ * includes/scctrace.h) into one Chrome trace (chrome://tracing, Perfetto):
+ *
+ *   tracemerge [-o trace.json] scc_trace.*
+ *
+ * Every node becomes a process. Sends, stalls and waits for incoming frames
+ * are slices, receives are linked to their send by a flow arrow, LUT and
+ * allocator events are instants.
+ *
+ * The nodes' clocks are first aligned by the wall-clock time each node
+ * sampled at startup and then corrected by the messages themselves: a frame
+ * cannot be received before it was sent, so the send and receive times of
+ * every pair of nodes bound the offset between their clocks. Starting from
+ * the lowest node, each node is placed in the middle of the bounds to a node
+ * placed before it (or at the closest bound if only one direction carried
+ * traffic). The offsets are printed to stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "includes/scctrace.h"
+
+#define MAX_NODES 256
+
+typedef struct {
+  trace_header_t hdr;
+  trace_event_t *events;
+  size_t count;
+  int64_t offset;
+  int placed;
+} trace_t;
+
+/* One end of a frame, for matching sends with receives. */
+typedef struct {
+  int from, to;
+  uint32_t seq;
+  int64_t ts;
+} msg_t;
+
+static trace_t traces[MAX_NODES];
+static int64_t lo[MAX_NODES][MAX_NODES];
+static char seen[MAX_NODES][MAX_NODES];
+
+static void load(const char *name)
+{
+  FILE *file = fopen(name, "r");
+  trace_header_t hdr;
+  trace_t *t;
+
+  if (file == NULL) {
+    perror(name);
+    exit(1);
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, file) != 1 || hdr.magic != TRACE_MAGIC || hdr.version != TRACE_VERSION
+      || hdr.node >= MAX_NODES) {
+    fprintf(stderr, "%s: not a trace file\n", name);
+    exit(1);
+  }
+
+  t = &traces[hdr.node];
+  if (t->events) {
+    fprintf(stderr, "%s: node %d given twice\n", name, hdr.node);
+    exit(1);
+  }
+
+  t->hdr = hdr;
+  t->count = hdr.count < TRACE_EVENTS ? hdr.count : TRACE_EVENTS;
+  t->events = malloc(t->count * sizeof(trace_event_t) + 1);
+  t->count = fread(t->events, sizeof(trace_event_t), t->count, file);
+  fclose(file);
+}
+
+static int compare_msg(const void *x, const void *y)
+{
+  const msg_t *a = x, *b = y;
+
+  if (a->from != b->from) return a->from - b->from;
+  if (a->to != b->to) return a->to - b->to;
+  return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static msg_t *collect(int type, size_t *n)
+{
+  int node;
+  size_t i, count = 0;
+  msg_t *msgs;
+
+  for (node = 0; node < MAX_NODES; node++) count += traces[node].count;
+  msgs = malloc(count * sizeof(msg_t) + 1);
+
+  for (node = 0, count = 0; node < MAX_NODES; node++) {
+    for (i = 0; i < traces[node].count; i++) {
+      trace_event_t *e = &traces[node].events[i];
+
+      if (e->type != type) continue;
+      msgs[count].from = type == TRACE_SEND_END ? node : e->peer;
+      msgs[count].to = type == TRACE_SEND_END ? e->peer : node;
+      msgs[count].seq = e->a;
+      msgs[count].ts = e->ts + traces[node].offset;
+      count++;
+    }
+  }
+
+  qsort(msgs, count, sizeof(msg_t), compare_msg);
+  *n = count;
+  return msgs;
+}
+
+/* lo[s][r]: the latest a frame from s arrived at r relative to its send,
+ * i.e. the clock of r must be shifted by at least lo[s][r]. */
+static void bound(void)
+{
+  size_t i = 0, j = 0, nsend, nrecv;
+  msg_t *send = collect(TRACE_SEND_END, &nsend), *recv = collect(TRACE_RECV, &nrecv);
+  int c;
+  int64_t d;
+
+  while (i < nsend && j < nrecv) {
+    if ((c = compare_msg(&send[i], &recv[j])) < 0) i++;
+    else if (c > 0) j++;
+    else {
+      d = send[i].ts - recv[j].ts;
+      if (!seen[send[i].from][send[i].to] || d > lo[send[i].from][send[i].to]) {
+        lo[send[i].from][send[i].to] = d;
+      }
+      seen[send[i].from][send[i].to] = 1;
+      i++, j++;
+    }
+  }
+
+  free(send);
+  free(recv);
+}
+
+/* Shift of node r relative to node s, which is already placed. */
+static int64_t shift(int s, int r)
+{
+  int64_t min = lo[s][r], max = -lo[r][s];
+
+  if (seen[s][r] && seen[r][s]) return (min + max) / 2;
+  if (seen[s][r]) return min > 0 ? min : 0;
+  return max < 0 ? max : 0;
+}
+
+static void align(void)
+{
+  int node, s, r, root = -1, queue[MAX_NODES], head = 0, tail = 0;
+  int64_t base, delta[MAX_NODES];
+
+  for (node = 0; node < MAX_NODES; node++) {
+    if (!traces[node].events) continue;
+    traces[node].offset = traces[node].hdr.real_ns - traces[node].hdr.mono_ns;
+    if (root < 0) root = node;
+  }
+
+  bound();
+
+  /* The bounds were taken with the wall-clock offsets, so a node's shift
+   * adds to that of the node it was placed against. */
+  traces[root].placed = 1;
+  delta[root] = 0;
+  queue[tail++] = root;
+  while (head < tail) {
+    s = queue[head++];
+    for (r = 0; r < MAX_NODES; r++) {
+      if (traces[r].placed || !traces[r].events || !(seen[s][r] || seen[r][s])) continue;
+      delta[r] = delta[s] + shift(s, r);
+      traces[r].offset += delta[r];
+      traces[r].placed = 1;
+      queue[tail++] = r;
+    }
+  }
+
+  /* Start the timeline at the first event. */
+  for (node = 0, base = INT64_MAX; node < MAX_NODES; node++) {
+    if (traces[node].count && traces[node].events[0].ts + traces[node].offset < base) {
+      base = traces[node].events[0].ts + traces[node].offset;
+    }
+  }
+
+  for (node = 0; node < MAX_NODES; node++) {
+    if (!traces[node].events) continue;
+    traces[node].offset -= base;
+    fprintf(stderr, "node %d: %lu events, offset %lld ns%s\n", node, (unsigned long) traces[node].count,
+            (long long) traces[node].offset, traces[node].placed ? "" : " (no messages, wall clock only)");
+  }
+}
+
+static FILE *out;
+static int first = 1;
+
+static void emit(const char *json, int node, double ts)
+{
+  fprintf(out, "%s\n{\"pid\":%d,\"tid\":0,\"ts\":%.3f,", first ? "" : ",", node, ts);
+  fputs(json, out);
+  first = 0;
+}
+
+static uint64_t flow_id(int from, int to, uint32_t seq)
+{
+  return (uint64_t) from << 40 | (uint64_t) to << 32 | seq;
+}
+
+static void export(int node)
+{
+  trace_t *t = &traces[node];
+  size_t i;
+  char buf[256];
+  double begin[MAX_NODES], wait = -1, us;
+
+  for (i = 0; i < MAX_NODES; i++) begin[i] = -1;
+
+  fprintf(out, "%s\n{\"pid\":%d,\"ph\":\"M\",\"name\":\"process_name\",\"args\":{\"name\":\"node %d\"}}",
+          first ? "" : ",", node, node);
+  first = 0;
+
+  for (i = 0; i < t->count; i++) {
+    trace_event_t *e = &t->events[i];
+
+    us = (e->ts + t->offset) / 1e3;
+    switch (e->type) {
+      case TRACE_SEND_BEGIN:
+        begin[e->peer] = us;
+        break;
+      case TRACE_SEND_END:
+        if (begin[e->peer] < 0) begin[e->peer] = us;
+        snprintf(buf, sizeof(buf), "\"ph\":\"X\",\"dur\":%.3f,\"name\":\"send %d\",\"cat\":\"mpb\","
+                 "\"args\":{\"seq\":%u,\"bytes\":%u}}", us - begin[e->peer], e->peer, e->a, e->b);
+        emit(buf, node, begin[e->peer]);
+        snprintf(buf, sizeof(buf), "\"ph\":\"s\",\"id\":%llu,\"name\":\"frame\",\"cat\":\"mpb\"}",
+                 (unsigned long long) flow_id(node, e->peer, e->a));
+        emit(buf, node, begin[e->peer]);
+        begin[e->peer] = -1;
+        break;
+      case TRACE_STALL:
+        snprintf(buf, sizeof(buf), "\"ph\":\"X\",\"dur\":%.3f,\"name\":\"stall %d\",\"cat\":\"mpb\","
+                 "\"args\":{\"bytes\":%u}}", (double) e->a, e->peer, e->b);
+        emit(buf, node, us - e->a);
+        break;
+      case TRACE_RECV:
+        snprintf(buf, sizeof(buf), "\"ph\":\"X\",\"dur\":0,\"name\":\"recv %d\",\"cat\":\"mpb\","
+                 "\"args\":{\"seq\":%u,\"bytes\":%u}}", e->peer, e->a, e->b);
+        emit(buf, node, us);
+        snprintf(buf, sizeof(buf), "\"ph\":\"f\",\"bp\":\"e\",\"id\":%llu,\"name\":\"frame\",\"cat\":\"mpb\"}",
+                 (unsigned long long) flow_id(e->peer, node, e->a));
+        emit(buf, node, us);
+        break;
+      case TRACE_WAIT_BEGIN:
+        wait = us;
+        break;
+      case TRACE_WAIT_END:
+        if (wait < 0) break;
+        snprintf(buf, sizeof(buf), "\"ph\":\"X\",\"dur\":%.3f,\"name\":\"wait\",\"cat\":\"mpb\"}", us - wait);
+        emit(buf, node, wait);
+        wait = -1;
+        break;
+      case TRACE_LUT_MAP:
+      case TRACE_LUT_HIT:
+        snprintf(buf, sizeof(buf), "\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"cat\":\"lut\","
+                 "\"args\":{\"node\":%d,\"lut\":%u,\"entries\":%u}}",
+                 e->type == TRACE_LUT_MAP ? "map" : "map (cached)", e->peer, e->a, e->b);
+        emit(buf, node, us);
+        break;
+      case TRACE_LUT_UNMAP:
+        snprintf(buf, sizeof(buf), "\"ph\":\"i\",\"s\":\"t\",\"name\":\"unmap\",\"cat\":\"lut\","
+                 "\"args\":{\"lut\":%u}}", e->a);
+        emit(buf, node, us);
+        break;
+      case TRACE_ALLOC:
+        snprintf(buf, sizeof(buf), "\"ph\":\"i\",\"s\":\"t\",\"name\":\"alloc\",\"cat\":\"heap\","
+                 "\"args\":{\"bytes\":%u}}", e->a);
+        emit(buf, node, us);
+        break;
+      case TRACE_FREE:
+        emit("\"ph\":\"i\",\"s\":\"t\",\"name\":\"free\",\"cat\":\"heap\"}", node, us);
+        break;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int opt, node;
+
+  out = stdout;
+  while ((opt = getopt(argc, argv, "o:")) != -1) {
+    switch (opt) {
+      case 'o':
+        if ((out = fopen(optarg, "w")) == NULL) {
+          perror("fopen");
+          exit(1);
+        }
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-o trace.json] scc_trace.<node>...\n", argv[0]);
+        exit(1);
+    }
+  }
+
+  if (optind == argc) {
+    fprintf(stderr, "Usage: %s [-o trace.json] scc_trace.<node>...\n", argv[0]);
+    exit(1);
+  }
+
+  for (; optind < argc; optind++) load(argv[optind]);
+  align();
+
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (node = 0; node < MAX_NODES; node++) {
+    if (traces[node].events) export(node);
+  }
+  fprintf(out, "\n]}\n");
+
+  fclose(out);
+  return 0;
+}